@@ -0,0 +1,121 @@
+#include "AllocCounter.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+static thread_local size_t allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  allocations++;
+  return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  free(p);
+}
+
+// Over-aligned types (C++17 and later)
+#ifdef __cpp_aligned_new
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  allocations++;
+  void *p = nullptr;
+  size_t align = static_cast<size_t>(alignment) < sizeof(void*) ? sizeof(void*) : static_cast<size_t>(alignment);
+  if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  try {
+    return operator new(size, alignment);
+  } catch (const std::bad_alloc &) {
+    return nullptr;
+  }
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &tag) noexcept {
+  return operator new(size, alignment, tag);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+  free(p);
+}
+
+#endif  // __cpp_aligned_new
+
+size_t AllocationCount() {
+  return allocations;
+}
+
+#else
+
+size_t AllocationCount() {
+  return 0;
+}
+
+#endif
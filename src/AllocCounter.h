@@ -0,0 +1,14 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstddef>
+
+/*
+* Number of calls to operator new (any form) made by the calling thread
+* since it started: the allocations of other threads (logger, trace writer,
+* other workers) are not counted. Only counted when built with
+* COUNT_ALLOCATIONS, always 0 otherwise.
+*/
+size_t AllocationCount();
+
+#endif /* ALLOC_COUNTER_H */
@@ -0,0 +1,292 @@
+#include "BayesOpt.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Search box: start point +/- BOUND initial steps
+static const double BOUND = 5.0;
+
+// Observation noise (standardized log cost), also keeps the kernel invertible
+static const double NOISE = 1E-4;
+
+// Candidates scored by expected improvement: uniform in the box, and
+// around the best point at several scales (fractions of the length scales)
+static const int GLOBAL_CANDIDATES = 500;
+static const int LOCAL_CANDIDATES = 300;
+static const double LOCAL_SCALES[] = { 0.3, 0.1, 0.03 };
+
+// Length scales tried for each coordinate
+static const double LENGTH_SCALES[] = { 0.25, 0.5, 1.0, 2.0, 4.0, 8.0 };
+
+namespace {
+
+// Squared exponential kernel, one length scale per coordinate
+double Kernel(const std::vector<double> &a, const std::vector<double> &b,
+              const std::vector<double> &length_scales) {
+  double d2 = 0.0;
+  for (size_t j = 0; j < a.size(); j++) {
+    double d = (a[j] - b[j]) / length_scales[j];
+    d2 += d * d;
+  }
+  return exp(-0.5 * d2);
+}
+
+// Lower Cholesky factor of the N x N matrix K (row major), false if not
+// positive definite
+bool Cholesky(const std::vector<double> &K, size_t N, std::vector<double> &L) {
+  L.assign(N * N, 0.0);
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j <= i; j++) {
+      double sum = K[i * N + j];
+      for (size_t k = 0; k < j; k++) {
+        sum -= L[i * N + k] * L[j * N + k];
+      }
+      if (i == j) {
+        if (sum <= 0.0) {
+          return false;
+        }
+        L[i * N + i] = sqrt(sum);
+      } else {
+        L[i * N + j] = sum / L[j * N + j];
+      }
+    }
+  }
+  return true;
+}
+
+// Solve L x = b (forward substitution)
+std::vector<double> SolveLower(const std::vector<double> &L, size_t N, const std::vector<double> &b) {
+  std::vector<double> x(N);
+  for (size_t i = 0; i < N; i++) {
+    double sum = b[i];
+    for (size_t k = 0; k < i; k++) {
+      sum -= L[i * N + k] * x[k];
+    }
+    x[i] = sum / L[i * N + i];
+  }
+  return x;
+}
+
+// Solve L^T x = b (back substitution)
+std::vector<double> SolveUpper(const std::vector<double> &L, size_t N, const std::vector<double> &b) {
+  std::vector<double> x(N);
+  for (size_t i = N; i-- > 0;) {
+    double sum = b[i];
+    for (size_t k = i + 1; k < N; k++) {
+      sum -= L[k * N + i] * x[k];
+    }
+    x[i] = sum / L[i * N + i];
+  }
+  return x;
+}
+
+}  // namespace
+
+BayesOpt::BayesOpt(const std::vector<double> &values, const std::vector<double> &steps, int budget)
+  : random(1) {
+  this->n = values.size();
+  this->origin = values;
+  this->steps = steps;
+  this->budget = budget;
+  this->length_scales.assign(n, 1.0);
+  this->best_cost = INFINITY;
+
+  // Initial design: the start point, then 2n points of a latin hypercube
+  int samples = 2 * n;
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<std::vector<double> > strata(n);
+  for (int j = 0; j < n; j++) {
+    for (int k = 0; k < samples; k++) {
+      strata[j].push_back((k + uniform(random)) / samples);
+    }
+    std::shuffle(strata[j].begin(), strata[j].end(), random);
+  }
+  design.push_back(std::vector<double>(n, 0.0));
+  for (int k = 0; k < samples; k++) {
+    std::vector<double> point(n);
+    for (int j = 0; j < n; j++) {
+      point[j] = BOUND * (2.0 * strata[j][k] - 1.0);
+    }
+    design.push_back(point);
+  }
+  this->candidate = design[0];
+}
+
+BayesOpt::~BayesOpt() {}
+
+std::vector<double> BayesOpt::Values(const std::vector<double> &point) const {
+  std::vector<double> values(n);
+  for (int j = 0; j < n; j++) {
+    values[j] = origin[j] + steps[j] * point[j];
+  }
+  return values;
+}
+
+std::vector<double> BayesOpt::Ask() const {
+  return Values(candidate);
+}
+
+std::vector<std::vector<double> > BayesOpt::Batch() const {
+  std::vector<std::vector<double> > batch;
+  if (points.size() < design.size()) {
+    // The rest of the initial design doesn't depend on the costs
+    for (size_t k = points.size(); k < design.size(); k++) {
+      batch.push_back(Values(design[k]));
+    }
+  } else {
+    batch.push_back(Ask());
+  }
+  return batch;
+}
+
+void BayesOpt::Tell(double cost) {
+  if (cost < best_cost) {
+    best_cost = cost;
+    best = Ask();
+  }
+  points.push_back(candidate);
+  observations.push_back(log(std::max(cost, 1E-12)));
+
+  if (points.size() < design.size()) {
+    candidate = design[points.size()];
+  } else if (!Done()) {
+    NextCandidate();
+  }
+}
+
+void BayesOpt::NextCandidate() {
+  size_t N = points.size();
+
+  // Standardized observations
+  double mean = 0.0;
+  for (double y : observations) {
+    mean += y;
+  }
+  mean /= N;
+  double variance = 0.0;
+  for (double y : observations) {
+    variance += (y - mean) * (y - mean);
+  }
+  double scale = sqrt(variance / N);
+  if (scale < 1E-12) {
+    scale = 1.0;
+  }
+  std::vector<double> y(N);
+  for (size_t i = 0; i < N; i++) {
+    y[i] = (observations[i] - mean) / scale;
+  }
+
+  // Length scales with the highest marginal likelihood: coordinate search
+  // from the current ones
+  std::vector<double> L;
+  std::vector<double> alpha;
+  double likelihood = Fit(length_scales, y, L, alpha);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int j = 0; j < n; j++) {
+      std::vector<double> ls = length_scales;
+      for (double l : LENGTH_SCALES) {
+        ls[j] = l;
+        std::vector<double> factor;
+        std::vector<double> a;
+        double fit = Fit(ls, y, factor, a);
+        if (fit > likelihood) {
+          likelihood = fit;
+          length_scales = ls;
+          L.swap(factor);
+          alpha.swap(a);
+        }
+      }
+    }
+  }
+  if (L.empty()) {
+    // Degenerate fit: random point
+    std::uniform_real_distribution<double> uniform(-BOUND, BOUND);
+    for (int j = 0; j < n; j++) {
+      candidate[j] = uniform(random);
+    }
+    return;
+  }
+
+  double y_best = *std::min_element(y.begin(), y.end());
+  size_t i_best = std::min_element(y.begin(), y.end()) - y.begin();
+
+  // Expected improvement (minimization) of each candidate
+  std::uniform_real_distribution<double> uniform(-BOUND, BOUND);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  double best_ei = -1.0;
+  std::vector<double> point(n);
+  std::vector<double> k(N);
+  for (int c = 0; c < GLOBAL_CANDIDATES + LOCAL_CANDIDATES; c++) {
+    for (int j = 0; j < n; j++) {
+      if (c < GLOBAL_CANDIDATES) {
+        point[j] = uniform(random);
+      } else {
+        double local_scale = LOCAL_SCALES[c % (sizeof(LOCAL_SCALES) / sizeof(LOCAL_SCALES[0]))];
+        point[j] = points[i_best][j] + local_scale * length_scales[j] * normal(random);
+      }
+      point[j] = std::max(-BOUND, std::min(BOUND, point[j]));
+    }
+    double mu = 0.0;
+    for (size_t i = 0; i < N; i++) {
+      k[i] = Kernel(points[i], point, length_scales);
+      mu += k[i] * alpha[i];
+    }
+    std::vector<double> v = SolveLower(L, N, k);
+    double var = 1.0;
+    for (size_t i = 0; i < N; i++) {
+      var -= v[i] * v[i];
+    }
+    double s = sqrt(std::max(var, 1E-12));
+    double z = (y_best - mu) / s;
+    double cdf = 0.5 * erfc(-z / sqrt(2.0));
+    double pdf = exp(-0.5 * z * z) / sqrt(2.0 * M_PI);
+    double ei = (y_best - mu) * cdf + s * pdf;
+    if (ei > best_ei) {
+      best_ei = ei;
+      candidate = point;
+    }
+  }
+}
+
+double BayesOpt::Fit(const std::vector<double> &ls, const std::vector<double> &y,
+                     std::vector<double> &L, std::vector<double> &alpha) const {
+  size_t N = points.size();
+  std::vector<double> K(N * N);
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      K[i * N + j] = Kernel(points[i], points[j], ls) + (i == j ? NOISE : 0.0);
+    }
+  }
+  if (!Cholesky(K, N, L)) {
+    L.clear();
+    return -INFINITY;
+  }
+  alpha = SolveUpper(L, N, SolveLower(L, N, y));
+
+  // log p(y) = -y^T K^-1 y / 2 - log|K| / 2 (+ constant)
+  double likelihood = 0.0;
+  for (size_t i = 0; i < N; i++) {
+    likelihood -= 0.5 * y[i] * alpha[i] + log(L[i * N + i]);
+  }
+  return likelihood;
+}
+
+bool BayesOpt::Done() const {
+  return static_cast<int>(points.size()) >= budget;
+}
+
+std::vector<double> BayesOpt::Best() const {
+  return best.empty() ? origin : best;
+}
+
+std::vector<double> BayesOpt::Spread() const {
+  std::vector<double> spread(n);
+  for (int j = 0; j < n; j++) {
+    spread[j] = steps[j] * length_scales[j];
+  }
+  return spread;
+}
+
+int BayesOpt::Iteration() const {
+  return points.size();
+}
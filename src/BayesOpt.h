@@ -0,0 +1,84 @@
+#ifndef BAYES_OPT_H
+#define BAYES_OPT_H
+
+#include <random>
+#include <vector>
+#include "Optimizer.h"
+
+/*
+* Bayesian optimization: Gaussian process surrogate of the log cost (squared
+* exponential kernel, one length scale per parameter picked by marginal
+* likelihood), next candidate by expected improvement. Searches the box of
+* +/- BOUND initial steps around the start point. Runs until the budget is
+* spent.
+*/
+class BayesOpt : public Optimizer {
+public:
+
+  /*
+  * Constructor
+  */
+  BayesOpt(const std::vector<double> &values, const std::vector<double> &steps, int budget);
+
+  /*
+  * Destructor.
+  */
+  virtual ~BayesOpt();
+
+  std::vector<double> Ask() const;
+
+  void Tell(double cost);
+
+  std::vector<std::vector<double> > Batch() const;
+
+  bool Done() const;
+
+  std::vector<double> Best() const;
+
+  std::vector<double> Spread() const;
+
+  int Iteration() const;
+
+private:
+  int n;
+
+  ///* start point and scale of each coordinate
+  std::vector<double> origin;
+  std::vector<double> steps;
+
+  ///* points run (scaled coordinates) and their log costs
+  std::vector<std::vector<double> > points;
+  std::vector<double> observations;
+
+  ///* initial design (start point and a latin hypercube), run first
+  std::vector<std::vector<double> > design;
+
+  ///* point to evaluate next
+  std::vector<double> candidate;
+
+  ///* kernel length scales of the current fit
+  std::vector<double> length_scales;
+
+  std::vector<double> best;
+  double best_cost;
+
+  std::mt19937 random;
+  int budget;
+
+  std::vector<double> Values(const std::vector<double> &point) const;
+
+  /*
+  * Factor the kernel matrix of the points with length scales ls, and solve
+  * for the standardized observations y. Returns the log marginal
+  * likelihood, -INFINITY if the matrix is singular.
+  */
+  double Fit(const std::vector<double> &ls, const std::vector<double> &y,
+             std::vector<double> &L, std::vector<double> &alpha) const;
+
+  /*
+  * Fit the process to the observations and pick the next candidate
+  */
+  void NextCandidate();
+};
+
+#endif /* BAYES_OPT_H */
@@ -0,0 +1,270 @@
+#include "CMAES.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Initial step size, in initial steps
+static const double SIGMA0 = 0.5;
+
+// Converged when the largest standard deviation is this small
+static const double TOLERANCE = 1E-8;
+
+namespace {
+
+// Eigen decomposition of the symmetric matrix A (cyclic Jacobi): A = V diag(d) V^T
+void Eigen(std::vector<std::vector<double> > A, std::vector<std::vector<double> > &V,
+           std::vector<double> &d) {
+  size_t n = A.size();
+  V.assign(n, std::vector<double>(n, 0.0));
+  for (size_t i = 0; i < n; i++) {
+    V[i][i] = 1.0;
+  }
+
+  for (int sweep = 0; sweep < 100; sweep++) {
+    double off = 0.0;
+    for (size_t p = 0; p < n; p++) {
+      for (size_t q = p + 1; q < n; q++) {
+        off += A[p][q] * A[p][q];
+      }
+    }
+    if (off < 1E-30) {
+      break;
+    }
+
+    for (size_t p = 0; p < n; p++) {
+      for (size_t q = p + 1; q < n; q++) {
+        if (A[p][q] == 0.0) {
+          continue;
+        }
+        // Rotation that zeroes A[p][q]
+        double theta = (A[q][q] - A[p][p]) / (2.0 * A[p][q]);
+        double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+        double c = 1.0 / sqrt(t * t + 1.0);
+        double s = t * c;
+        for (size_t k = 0; k < n; k++) {
+          double akp = A[k][p];
+          double akq = A[k][q];
+          A[k][p] = c * akp - s * akq;
+          A[k][q] = s * akp + c * akq;
+        }
+        for (size_t k = 0; k < n; k++) {
+          double apk = A[p][k];
+          double aqk = A[q][k];
+          A[p][k] = c * apk - s * aqk;
+          A[q][k] = s * apk + c * aqk;
+        }
+        for (size_t k = 0; k < n; k++) {
+          double vkp = V[k][p];
+          double vkq = V[k][q];
+          V[k][p] = c * vkp - s * vkq;
+          V[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+
+  d.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    d[i] = A[i][i];
+  }
+}
+
+}  // namespace
+
+CMAES::CMAES(const std::vector<double> &values, const std::vector<double> &steps, int budget)
+  : random(1) {
+  this->origin = values;
+  this->steps = steps;
+  this->budget = budget;
+  this->evaluations = 0;
+  this->generation = 0;
+  this->best_cost = INFINITY;
+
+  // Default strategy parameters
+  this->n = values.size();
+  this->lambda = 4 + static_cast<int>(3 * log(n));
+  this->mu = lambda / 2;
+  double sum = 0.0;
+  for (int i = 0; i < mu; i++) {
+    weights.push_back(log(mu + 0.5) - log(i + 1.0));
+    sum += weights[i];
+  }
+  double sum_squares = 0.0;
+  for (int i = 0; i < mu; i++) {
+    weights[i] /= sum;
+    sum_squares += weights[i] * weights[i];
+  }
+  this->mu_eff = 1.0 / sum_squares;
+  this->cc = (4.0 + mu_eff / n) / (n + 4.0 + 2.0 * mu_eff / n);
+  this->cs = (mu_eff + 2.0) / (n + mu_eff + 5.0);
+  this->c1 = 2.0 / ((n + 1.3) * (n + 1.3) + mu_eff);
+  this->cmu = std::min(1.0 - c1, 2.0 * (mu_eff - 2.0 + 1.0 / mu_eff) / ((n + 2.0) * (n + 2.0) + mu_eff));
+  this->damps = 1.0 + 2.0 * std::max(0.0, sqrt((mu_eff - 1.0) / (n + 1.0)) - 1.0) + cs;
+  this->chi_n = sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+  // Start: mean on the start point, identity covariance
+  this->mean.assign(n, 0.0);
+  this->sigma = SIGMA0;
+  this->C.assign(n, std::vector<double>(n, 0.0));
+  this->B = C;
+  for (int i = 0; i < n; i++) {
+    C[i][i] = 1.0;
+    B[i][i] = 1.0;
+  }
+  this->D.assign(n, 1.0);
+  this->pc.assign(n, 0.0);
+  this->ps.assign(n, 0.0);
+
+  Sample();
+}
+
+CMAES::~CMAES() {}
+
+std::vector<double> CMAES::Values(const std::vector<double> &point) const {
+  std::vector<double> values(n);
+  for (int j = 0; j < n; j++) {
+    values[j] = origin[j] + steps[j] * point[j];
+  }
+  return values;
+}
+
+void CMAES::Sample() {
+  // x = mean + sigma * B * D * z, z ~ N(0, I)
+  std::normal_distribution<double> normal(0.0, 1.0);
+  population.assign(lambda, std::vector<double>(n, 0.0));
+  for (int k = 0; k < lambda; k++) {
+    std::vector<double> z(n);
+    for (int i = 0; i < n; i++) {
+      z[i] = D[i] * normal(random);
+    }
+    for (int i = 0; i < n; i++) {
+      double y = 0.0;
+      for (int j = 0; j < n; j++) {
+        y += B[i][j] * z[j];
+      }
+      population[k][i] = mean[i] + sigma * y;
+    }
+  }
+  costs.clear();
+}
+
+std::vector<double> CMAES::Ask() const {
+  return Values(population[costs.size()]);
+}
+
+std::vector<std::vector<double> > CMAES::Batch() const {
+  std::vector<std::vector<double> > batch;
+  for (size_t k = costs.size(); k < population.size(); k++) {
+    batch.push_back(Values(population[k]));
+  }
+  return batch;
+}
+
+void CMAES::Tell(double cost) {
+  evaluations++;
+  if (cost < best_cost) {
+    best_cost = cost;
+    best = Ask();
+  }
+  costs.push_back(cost);
+  if (static_cast<int>(costs.size()) == lambda) {
+    Update();
+    generation++;
+    Sample();
+  }
+}
+
+void CMAES::Update() {
+  // Candidates by cost
+  std::vector<int> order(lambda);
+  for (int k = 0; k < lambda; k++) {
+    order[k] = k;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return costs[a] < costs[b]; });
+
+  // New mean: weighted recombination of the mu best
+  std::vector<double> old_mean = mean;
+  mean.assign(n, 0.0);
+  for (int i = 0; i < mu; i++) {
+    for (int j = 0; j < n; j++) {
+      mean[j] += weights[i] * population[order[i]][j];
+    }
+  }
+  std::vector<double> step(n);
+  for (int j = 0; j < n; j++) {
+    step[j] = (mean[j] - old_mean[j]) / sigma;
+  }
+
+  // Step size path: C^-1/2 * step = B * D^-1 * B^T * step
+  std::vector<double> bt_step(n, 0.0);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      bt_step[i] += B[j][i] * step[j];
+    }
+    bt_step[i] /= D[i];
+  }
+  double ps_norm = 0.0;
+  for (int i = 0; i < n; i++) {
+    double whitened = 0.0;
+    for (int j = 0; j < n; j++) {
+      whitened += B[i][j] * bt_step[j];
+    }
+    ps[i] = (1.0 - cs) * ps[i] + sqrt(cs * (2.0 - cs) * mu_eff) * whitened;
+    ps_norm += ps[i] * ps[i];
+  }
+  ps_norm = sqrt(ps_norm);
+
+  // Covariance path, stalled while the step size path is long
+  double hsig_bound = (1.4 + 2.0 / (n + 1.0)) * chi_n;
+  bool hsig = ps_norm / sqrt(1.0 - pow(1.0 - cs, 2.0 * (generation + 1))) < hsig_bound;
+  for (int i = 0; i < n; i++) {
+    pc[i] = (1.0 - cc) * pc[i] + (hsig ? sqrt(cc * (2.0 - cc) * mu_eff) * step[i] : 0.0);
+  }
+
+  // Covariance: rank-one and rank-mu updates
+  double delta = hsig ? 0.0 : cc * (2.0 - cc);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j <= i; j++) {
+      double rank_mu = 0.0;
+      for (int k = 0; k < mu; k++) {
+        const std::vector<double> &x = population[order[k]];
+        rank_mu += weights[k] * (x[i] - old_mean[i]) * (x[j] - old_mean[j]) / (sigma * sigma);
+      }
+      C[i][j] = (1.0 - c1 - cmu) * C[i][j] + c1 * (pc[i] * pc[j] + delta * C[i][j]) + cmu * rank_mu;
+      C[j][i] = C[i][j];
+    }
+  }
+
+  sigma *= exp((cs / damps) * (ps_norm / chi_n - 1.0));
+
+  // B and D for the next generation
+  std::vector<double> eigenvalues;
+  Eigen(C, B, eigenvalues);
+  for (int i = 0; i < n; i++) {
+    D[i] = sqrt(std::max(eigenvalues[i], 1E-20));
+  }
+}
+
+bool CMAES::Done() const {
+  if (evaluations >= budget) {
+    return true;
+  }
+  double largest = *std::max_element(D.begin(), D.end());
+  return sigma * largest < TOLERANCE;
+}
+
+std::vector<double> CMAES::Best() const {
+  return best.empty() ? Values(mean) : best;
+}
+
+std::vector<double> CMAES::Spread() const {
+  std::vector<double> spread(n);
+  for (int j = 0; j < n; j++) {
+    spread[j] = steps[j] * sigma * sqrt(C[j][j]);
+  }
+  return spread;
+}
+
+int CMAES::Iteration() const {
+  return generation;
+}
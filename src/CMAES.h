@@ -0,0 +1,89 @@
+#ifndef CMAES_H
+#define CMAES_H
+
+#include <random>
+#include <vector>
+#include "Optimizer.h"
+
+/*
+* Covariance matrix adaptation evolution strategy (Hansen's (mu/mu_w, lambda)
+* CMA-ES with default parameters), in coordinates scaled by the initial
+* steps. A generation of lambda candidates can be run in parallel.
+*/
+class CMAES : public Optimizer {
+public:
+
+  /*
+  * Constructor
+  */
+  CMAES(const std::vector<double> &values, const std::vector<double> &steps, int budget);
+
+  /*
+  * Destructor.
+  */
+  virtual ~CMAES();
+
+  std::vector<double> Ask() const;
+
+  void Tell(double cost);
+
+  std::vector<std::vector<double> > Batch() const;
+
+  bool Done() const;
+
+  std::vector<double> Best() const;
+
+  std::vector<double> Spread() const;
+
+  int Iteration() const;
+
+private:
+  typedef std::vector<std::vector<double> > Matrix;
+
+  int n;
+  int lambda;
+  int mu;
+  std::vector<double> weights;
+  double mu_eff;
+  double cc;
+  double cs;
+  double c1;
+  double cmu;
+  double damps;
+  double chi_n;
+
+  ///* start point and scale of each coordinate
+  std::vector<double> origin;
+  std::vector<double> steps;
+
+  ///* distribution: mean, step size, covariance = B diag(D^2) B^T
+  std::vector<double> mean;
+  double sigma;
+  Matrix C;
+  Matrix B;
+  std::vector<double> D;
+
+  ///* evolution paths
+  std::vector<double> pc;
+  std::vector<double> ps;
+
+  ///* current generation (scaled coordinates) and the costs told so far
+  Matrix population;
+  std::vector<double> costs;
+
+  std::vector<double> best;
+  double best_cost;
+
+  std::mt19937 random;
+  int evaluations;
+  int budget;
+  int generation;
+
+  std::vector<double> Values(const std::vector<double> &point) const;
+
+  void Sample();
+
+  void Update();
+};
+
+#endif /* CMAES_H */
@@ -0,0 +1,271 @@
+#include "Checkpoint.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "json.hpp"
+
+// for convenience
+using json = nlohmann::json;
+
+namespace {
+
+// 2: max_dist, schedule breakpoint; 3: run cache; 4: pruner state
+const int CHECKPOINT_VERSION = 4;
+
+// Doubles are stored as hexadecimal floats ("%a"): exact round trip,
+// infinity included, so a resumed run is identical to an uninterrupted one.
+std::string Hex(double x) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%a", x);
+  return buf;
+}
+
+double Unhex(const json &j) {
+  return strtod(j.get<std::string>().c_str(), nullptr);
+}
+
+json HexArray(const std::vector<double> &values) {
+  json j = json::array();
+  for (double x : values) {
+    j.push_back(Hex(x));
+  }
+  return j;
+}
+
+std::vector<double> UnhexArray(const json &j) {
+  std::vector<double> values;
+  for (const json &x : j) {
+    values.push_back(Unhex(x));
+  }
+  return values;
+}
+
+}  // namespace
+
+std::string CheckpointData(const Twiddle &tw, const PID &pid, const std::string &schedule, int breakpoint) {
+  json j;
+  j["version"] = CHECKPOINT_VERSION;
+  j["max_dist"] = tw.max_dist;
+  j["schedule"] = schedule;
+  j["breakpoint"] = breakpoint;
+  j["is_used"] = tw.is_used;
+  j["is_initialized"] = tw.is_initialized;
+  j["it"] = tw.it;
+  j["param_index"] = tw.param_index;
+  j["dist_count"] = tw.dist_count;
+  j["best_dist"] = tw.best_dist;
+  j["best_error"] = Hex(tw.best_error);
+  j["error"] = Hex(tw.error);
+  j["curve"] = HexArray(tw.curve);
+
+  j["params"] = json::array();
+  for (int i = 0; i < tw.nb_params; i++) {
+    json param;
+    param["name"] = tw.names[i];
+    param["value"] = Hex(*tw.params[i]);
+    param["dp"] = Hex(tw.dp[i].value);
+    param["direction"] = tw.dp[i].direction == DIRECTION::FORWARD ? "forward" : "backward";
+    j["params"].push_back(param);
+  }
+
+  // Curve the runs are compared with (--prune), and the counters
+  j["prune"]["confidence"] = Hex(tw.pruner.confidence);
+  j["prune"]["best"] = HexArray(tw.pruner.best);
+  j["prune"]["pruned"] = tw.pruner.pruned;
+  j["prune"]["saved"] = tw.pruner.saved;
+
+  // Scores already known (--cache): a resumed run doesn't run them again
+  j["cache"]["tolerance"] = Hex(tw.cache.tolerance);
+  j["cache"]["hits"] = tw.cache.hits;
+  j["cache"]["misses"] = tw.cache.misses;
+  j["cache"]["results"] = json::array();
+  for (const auto &entry : tw.cache.results) {
+    json result;
+    result["key"] = entry.first;
+    result["avg_error"] = Hex(entry.second.avg_error);
+    result["dist"] = entry.second.dist;
+    result["curve"] = HexArray(entry.second.curve);
+    result["pruned"] = entry.second.pruned;
+    j["cache"]["results"].push_back(result);
+  }
+
+  j["pid"]["p_error"] = Hex(pid.p_error);
+  j["pid"]["i_error"] = Hex(pid.i_error);
+  j["pid"]["d_error"] = Hex(pid.d_error);
+  return j.dump(2) + "\n";
+}
+
+bool WriteCheckpoint(const std::string &path, const std::string &data) {
+  // Write, flush to disk, then atomically replace the previous checkpoint
+  const std::string tmp = path + ".tmp";
+  FILE *file = fopen(tmp.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = fflush(file) == 0 && ok;
+  ok = fsync(fileno(file)) == 0 && ok;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SaveCheckpoint(const std::string &path, const Twiddle &tw, const PID &pid,
+                    const std::string &schedule, int breakpoint) {
+  return WriteCheckpoint(path, CheckpointData(tw, pid, schedule, breakpoint));
+}
+
+CheckpointWriter::CheckpointWriter(const std::string &path) : path(path) {
+  this->pending = false;
+  this->running = true;
+  this->thread = std::thread(&CheckpointWriter::Run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  changed.notify_one();
+  thread.join();
+}
+
+void CheckpointWriter::Save(const Twiddle &tw, const PID &pid, const std::string &schedule, int breakpoint) {
+  std::string state = CheckpointData(tw, pid, schedule, breakpoint);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    data.swap(state);
+    pending = true;
+  }
+  changed.notify_one();
+}
+
+void CheckpointWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    changed.wait(lock, [this]() { return pending || !running; });
+    if (!pending) {
+      break;
+    }
+    // Newest state only: the ones saved while writing are skipped
+    std::string state;
+    state.swap(data);
+    pending = false;
+    lock.unlock();
+    if (!WriteCheckpoint(path, state)) {
+      std::cerr << "Failed to write checkpoint " << path << std::endl;
+    }
+    lock.lock();
+  }
+}
+
+bool LoadCheckpoint(const std::string &path, Twiddle &tw, PID &pid,
+                    const std::string &schedule, int breakpoint) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open checkpoint " << path << std::endl;
+    return false;
+  }
+
+  try {
+    json j = json::parse(in);
+    if (j["version"].get<int>() != CHECKPOINT_VERSION) {
+      std::cerr << "Unsupported checkpoint version in " << path << std::endl;
+      return false;
+    }
+
+    // Runs of another length: their errors can't be compared
+    if (j["max_dist"].get<int>() != tw.max_dist) {
+      std::cerr << "Checkpoint " << path << " was tuned over max_dist " << j["max_dist"].get<int>()
+                << ", not " << tw.max_dist << std::endl;
+      return false;
+    }
+
+    // Same names (Kp, Ki, Kd) for every breakpoint: the values and steps
+    // are those of the saved one
+    if (j["schedule"].get<std::string>() != schedule || j["breakpoint"].get<int>() != breakpoint) {
+      std::cerr << "Checkpoint " << path << " tunes breakpoint " << j["breakpoint"].get<int>() << " of schedule \""
+                << j["schedule"].get<std::string>() << "\", not " << breakpoint << " of \"" << schedule << "\""
+                << " (-1: the fixed gains)" << std::endl;
+      return false;
+    }
+
+    // Runs pruned otherwise: another candidate sequence
+    double confidence = Unhex(j["prune"]["confidence"]);
+    if (confidence != tw.pruner.confidence) {
+      std::cerr << "Checkpoint " << path << " was tuned with --prune " << confidence << ", not "
+                << tw.pruner.confidence << " (0: no pruning)" << std::endl;
+      return false;
+    }
+
+    // Other keys, or no cache
+    double tolerance = Unhex(j["cache"]["tolerance"]);
+    if (tolerance != tw.cache.tolerance) {
+      std::cerr << "Checkpoint " << path << " was tuned with --cache " << tolerance << ", not "
+                << tw.cache.tolerance << " (0: no cache)" << std::endl;
+      return false;
+    }
+
+    const json &params = j["params"];
+    if (static_cast<int>(params.size()) != tw.nb_params) {
+      std::cerr << "Checkpoint " << path << " doesn't tune the same parameters" << std::endl;
+      return false;
+    }
+    for (int i = 0; i < tw.nb_params; i++) {
+      if (params[i]["name"].get<std::string>() != tw.names[i]) {
+        std::cerr << "Checkpoint " << path << " doesn't tune the same parameters" << std::endl;
+        return false;
+      }
+    }
+
+    for (int i = 0; i < tw.nb_params; i++) {
+      *tw.params[i] = Unhex(params[i]["value"]);
+      tw.dp[i].value = Unhex(params[i]["dp"]);
+      tw.dp[i].direction = params[i]["direction"].get<std::string>() == "forward" ?
+        DIRECTION::FORWARD : DIRECTION::BACKWARD;
+    }
+
+    tw.is_used = j["is_used"].get<bool>();
+    tw.is_initialized = j["is_initialized"].get<bool>();
+    tw.it = j["it"].get<int>();
+    tw.param_index = j["param_index"].get<int>();
+    tw.dist_count = j["dist_count"].get<int>();
+    tw.best_dist = j["best_dist"].get<int>();
+    tw.best_error = Unhex(j["best_error"]);
+    tw.error = Unhex(j["error"]);
+    tw.avg_error = tw.dist_count > 0 ? tw.error / tw.dist_count : 0.0;
+    tw.curve = UnhexArray(j["curve"]);
+
+    tw.pruner.best = UnhexArray(j["prune"]["best"]);
+    tw.pruner.pruned = j["prune"]["pruned"].get<long>();
+    tw.pruner.saved = j["prune"]["saved"].get<long>();
+
+    tw.cache.hits = j["cache"]["hits"].get<long>();
+    tw.cache.misses = j["cache"]["misses"].get<long>();
+    tw.cache.results.clear();
+    for (const json &entry : j["cache"]["results"]) {
+      run_result result;
+      result.avg_error = Unhex(entry["avg_error"]);
+      result.dist = entry["dist"].get<int>();
+      result.curve = UnhexArray(entry["curve"]);
+      result.pruned = entry["pruned"].get<bool>();
+      tw.cache.results[entry["key"].get<std::vector<long long> >()] = result;
+    }
+
+    pid.p_error = Unhex(j["pid"]["p_error"]);
+    pid.i_error = Unhex(j["pid"]["i_error"]);
+    pid.d_error = Unhex(j["pid"]["d_error"]);
+  }
+  catch (const std::exception &e) {
+    std::cerr << "Invalid checkpoint " << path << ": " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "PID.h"
+#include "Twiddle.h"
+
+/*
+* Save the Twiddle state (its run cache and pruner included) and the PID
+* errors to a JSON file, with the gain schedule file and breakpoint Twiddle
+* tunes (--schedule, --breakpoint; -1 if none). The file is written next to
+* path then renamed, so a crash never leaves it half written.
+*/
+bool SaveCheckpoint(const std::string &path, const Twiddle &tw, const PID &pid,
+                    const std::string &schedule, int breakpoint);
+
+/*
+* The two halves of SaveCheckpoint: the state as the file contents, and
+* their (slow: fsync) write
+*/
+std::string CheckpointData(const Twiddle &tw, const PID &pid, const std::string &schedule, int breakpoint);
+bool WriteCheckpoint(const std::string &path, const std::string &data);
+
+/*
+* Saves checkpoints from a background thread: Save only captures the state,
+* so that callers holding a lock (e.g. the farm's) don't wait for the disk.
+* Only the newest state not written yet is written; the destructor writes
+* the last one.
+*/
+class CheckpointWriter {
+public:
+
+  /*
+  * Constructor
+  */
+  CheckpointWriter(const std::string &path);
+
+  /*
+  * Destructor.
+  */
+  virtual ~CheckpointWriter();
+
+  void Save(const Twiddle &tw, const PID &pid, const std::string &schedule, int breakpoint);
+
+private:
+  const std::string path;
+
+  ///* state to write, if pending
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::string data;
+  bool pending;
+  bool running;
+
+  std::thread thread;
+
+  void Run();
+};
+
+/*
+* Restore a checkpoint. Twiddle must have the same parameters registered,
+* the same max_dist, cache tolerance and prune confidence, and tune the
+* same schedule breakpoint (if any).
+*/
+bool LoadCheckpoint(const std::string &path, Twiddle &tw, PID &pid,
+                    const std::string &schedule, int breakpoint);
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,291 @@
+#include "Codec.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "json.hpp"
+
+// for convenience
+using json = nlohmann::json;
+
+namespace {
+
+const char *SkipSpaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+// Returns a pointer past the closing quote of the string starting at p
+const char *SkipString(const char *p, const char *end) {
+  for (p++; p < end; p++) {
+    if (*p == '\\') {
+      p++;
+    } else if (*p == '"') {
+      return p + 1;
+    }
+  }
+  return nullptr;
+}
+
+// Returns a pointer past the value (string, number, literal, object or array) starting at p
+const char *SkipValue(const char *p, const char *end) {
+  if (*p == '"') {
+    return SkipString(p, end);
+  }
+  if (*p == '{' || *p == '[') {
+    int depth = 0;
+    while (p < end) {
+      if (*p == '"') {
+        p = SkipString(p, end);
+        if (p == nullptr) {
+          return nullptr;
+        }
+        continue;
+      }
+      if (*p == '{' || *p == '[') {
+        depth++;
+      } else if ((*p == '}' || *p == ']') && --depth == 0) {
+        return p + 1;
+      }
+      p++;
+    }
+    return nullptr;
+  }
+  while (p < end && *p != ',' && *p != '}' && *p != ']') {
+    p++;
+  }
+  return p;
+}
+
+// Parse a number, quoted (as sent by the simulator) or not.
+// The digits are copied to a small stack buffer so strtod gives exactly
+// the same result as std::stod on the json string.
+const char *ParseNumber(const char *p, const char *end, double &value) {
+  const bool quoted = *p == '"';
+  if (quoted) {
+    p++;
+  }
+
+  char buf[64];
+  size_t n = 0;
+  while (p < end && *p != '"' && *p != ',' && *p != '}' && *p != ']') {
+    if (n == sizeof(buf) - 1) {
+      return nullptr;
+    }
+    buf[n++] = *p++;
+  }
+  if (quoted) {
+    if (p == end || *p != '"') {
+      return nullptr;
+    }
+    p++;
+  }
+  buf[n] = '\0';
+
+  char *stop;
+  value = strtod(buf, &stop);
+  if (n == 0 || stop != buf + n) {
+    return nullptr;
+  }
+  return p;
+}
+
+// Write a double the way json::dump() does: "%.15g", ".0" appended to
+// integer-like values, "null" for NaN and infinity
+char *WriteNumber(double x, char *p, char *end) {
+  if (!std::isfinite(x)) {
+    memcpy(p, "null", 4);
+    return p + 4;
+  }
+  if (x == 0) {
+    if (std::signbit(x)) {
+      *p++ = '-';
+    }
+    memcpy(p, "0.0", 3);
+    return p + 3;
+  }
+
+  const int n = snprintf(p, end - p, "%.15g", x);
+  bool int_like = true;
+  for (int i = 0; i < n; i++) {
+    if (p[i] == '.' || p[i] == 'e' || p[i] == 'E') {
+      int_like = false;
+      break;
+    }
+  }
+  p += n;
+  if (int_like) {
+    memcpy(p, ".0", 2);
+    p += 2;
+  }
+  return p;
+}
+
+char *WriteString(const char *s, size_t length, char *p) {
+  memcpy(p, s, length);
+  return p + length;
+}
+
+bool KeyIs(const char *key, size_t length, const char *name) {
+  return length == strlen(name) && memcmp(key, name, length) == 0;
+}
+
+}  // namespace
+
+EVENT ParseTelemetry(const char *data, size_t length, Telemetry &telemetry) {
+  static const char event[] = "\"telemetry\"";
+  static const size_t event_length = sizeof(event) - 1;
+
+  const char *end = data + length;
+  if (length < 2 || data[0] != '4' || data[1] != '2') {
+    return EVENT_OTHER;
+  }
+
+  // Event name
+  const char *p = SkipSpaces(data + 2, end);
+  if (p == end || *p != '[') {
+    return EVENT_OTHER;
+  }
+  p = SkipSpaces(p + 1, end);
+  if (static_cast<size_t>(end - p) < event_length || memcmp(p, event, event_length) != 0) {
+    return EVENT_OTHER;
+  }
+  p = SkipSpaces(p + event_length, end);
+  if (p == end || *p != ',') {
+    return EVENT_OTHER;
+  }
+  p = SkipSpaces(p + 1, end);
+
+  // No data: the simulator is in manual mode
+  if (end - p >= 4 && memcmp(p, "null", 4) == 0) {
+    return EVENT_MANUAL;
+  }
+  if (p == end || *p != '{') {
+    return EVENT_OTHER;
+  }
+
+  // Data object: pick cte, speed and steering_angle, skip everything else
+  const int CTE = 1, SPEED = 2, ANGLE = 4;
+  int found = 0;
+  telemetry.steering_angle = 0.0;
+  p = SkipSpaces(p + 1, end);
+  while (p < end && *p != '}') {
+    if (*p != '"') {
+      return EVENT_OTHER;
+    }
+    const char *key = p + 1;
+    p = SkipString(p, end);
+    if (p == nullptr) {
+      return EVENT_OTHER;
+    }
+    const size_t key_length = p - 1 - key;
+
+    p = SkipSpaces(p, end);
+    if (p == end || *p != ':') {
+      return EVENT_OTHER;
+    }
+    p = SkipSpaces(p + 1, end);
+    if (p == end) {
+      return EVENT_OTHER;
+    }
+
+    if (KeyIs(key, key_length, "cte")) {
+      p = ParseNumber(p, end, telemetry.cte);
+      found |= CTE;
+    } else if (KeyIs(key, key_length, "speed")) {
+      p = ParseNumber(p, end, telemetry.speed);
+      found |= SPEED;
+    } else if (KeyIs(key, key_length, "steering_angle")) {
+      p = ParseNumber(p, end, telemetry.steering_angle);
+      found |= ANGLE;
+    } else if (*p == 'n') {
+      // hasData treats any "null" as manual mode, let the generic path decide
+      return EVENT_OTHER;
+    } else {
+      p = SkipValue(p, end);
+    }
+    if (p == nullptr) {
+      return EVENT_OTHER;
+    }
+
+    p = SkipSpaces(p, end);
+    if (p < end && *p == ',') {
+      p = SkipSpaces(p + 1, end);
+    }
+  }
+  if (p == end) {
+    return EVENT_OTHER;
+  }
+  p = SkipSpaces(p + 1, end);
+  if (p == end || *p != ']') {
+    return EVENT_OTHER;
+  }
+
+  if ((found & (CTE | SPEED)) != (CTE | SPEED)) {
+    return EVENT_OTHER;
+  }
+  return EVENT_TELEMETRY;
+}
+
+void EncodeSteer(double steering_angle, double throttle, Message &msg) {
+  static const char head[] = "42[\"steer\",{\"steering_angle\":";
+  static const char middle[] = ",\"throttle\":";
+  static const char tail[] = "}]";
+
+  // json objects are sorted by key: steering_angle comes before throttle
+  char *p = msg.data;
+  char *end = msg.data + sizeof(msg.data);
+  p = WriteString(head, sizeof(head) - 1, p);
+  p = WriteNumber(steering_angle, p, end);
+  p = WriteString(middle, sizeof(middle) - 1, p);
+  p = WriteNumber(throttle, p, end);
+  p = WriteString(tail, sizeof(tail) - 1, p);
+  msg.length = p - msg.data;
+}
+
+void EncodeTelemetry(const Telemetry &telemetry, double throttle, Message &msg) {
+  int n = snprintf(msg.data, sizeof(msg.data),
+                   "42[\"telemetry\",{\"cte\":\"%.4f\",\"speed\":\"%.4f\","
+                   "\"steering_angle\":\"%.4f\",\"throttle\":\"%.4f\"}]",
+                   telemetry.cte, telemetry.speed, telemetry.steering_angle, throttle);
+  // Too long (huge values): send what fits, the parser will reject it
+  msg.length = n < static_cast<int>(sizeof(msg.data)) ? n : sizeof(msg.data) - 1;
+}
+
+EVENT ParseEvent(const char *data, size_t length, Telemetry &telemetry) {
+  auto s = hasData(std::string(data, length));
+  if (s == "") {
+    return EVENT_MANUAL;
+  }
+
+  auto j = json::parse(s);
+  std::string event = j[0].get<std::string>();
+  if (event != "telemetry") {
+    return EVENT_OTHER;
+  }
+
+  // j[1] is the data JSON object
+  telemetry.cte = std::stod(j[1]["cte"].get<std::string>());
+  telemetry.speed = std::stod(j[1]["speed"].get<std::string>());
+  telemetry.steering_angle = 0.0;
+  if (j[1].count("steering_angle")) {
+    telemetry.steering_angle = std::stod(j[1]["steering_angle"].get<std::string>());
+  }
+  return EVENT_TELEMETRY;
+}
+
+std::string hasData(std::string s) {
+  auto found_null = s.find("null");
+  auto b1 = s.find_first_of("[");
+  auto b2 = s.find_last_of("]");
+  if (found_null != std::string::npos) {
+    return "";
+  }
+  else if (b1 != std::string::npos && b2 != std::string::npos) {
+    return s.substr(b1, b2 - b1 + 1);
+  }
+  return "";
+}
@@ -0,0 +1,70 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <string>
+
+/*
+* Kind of Socket.IO event found in a "42" message
+*/
+enum EVENT {
+  EVENT_TELEMETRY,
+  EVENT_MANUAL,
+  EVENT_OTHER
+};
+
+/*
+* Values read from a telemetry event
+*/
+struct Telemetry {
+  double cte;
+  double speed;
+  double steering_angle;
+};
+
+/*
+* Outgoing message, formatted in a fixed buffer
+*/
+struct Message {
+  char data[128];
+  size_t length;
+};
+
+/*
+* Constant replies
+*/
+const char RESET_MESSAGE[] = "42[\"reset\",{}]";
+const char MANUAL_MESSAGE[] = "42[\"manual\",{}]";
+
+/*
+* Parse a "42[\"telemetry\",{...}]" message in place, without allocating.
+* Returns EVENT_OTHER for anything it does not recognize, in which case the
+* generic (json) path should be used instead.
+*/
+EVENT ParseTelemetry(const char *data, size_t length, Telemetry &telemetry);
+
+/*
+* Generic parser based on hasData + json::parse. Slow, but handles any event.
+*/
+EVENT ParseEvent(const char *data, size_t length, Telemetry &telemetry);
+
+/*
+* Format a "42[\"steer\",{...}]" reply, byte for byte what
+* json::dump() produces for the same steering_angle/throttle object.
+*/
+void EncodeSteer(double steering_angle, double throttle, Message &msg);
+
+/*
+* Format a telemetry event the way the simulator sends it
+* (values as strings with 4 decimals)
+*/
+void EncodeTelemetry(const Telemetry &telemetry, double throttle, Message &msg);
+
+/*
+* Checks if the SocketIO event has JSON data.
+* If there is data the JSON object in string format will be returned,
+* else the empty string "" will be returned.
+*/
+std::string hasData(std::string s);
+
+#endif /* CODEC_H */
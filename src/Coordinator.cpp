@@ -0,0 +1,143 @@
+#include "Coordinator.h"
+
+Coordinator::Coordinator(Twiddle &tw, Logger &log) : tw(tw), log(log) {
+  this->on_end_run = []() {};
+  this->on_done = []() {};
+  this->version = 0;
+  this->next_ticket = 0;
+  this->simulators = 0;
+}
+
+Coordinator::~Coordinator() {}
+
+void Coordinator::Attach() {
+  std::lock_guard<std::mutex> lock(mutex);
+  simulators++;
+  Refresh();
+}
+
+void Coordinator::Detach() {
+  std::lock_guard<std::mutex> lock(mutex);
+  simulators--;
+  Refresh();
+}
+
+bool Coordinator::Acquire(std::vector<double> &candidate, long &ticket, Pruner &pruner) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!tw.is_used) {
+    return false;
+  }
+  for (slot &s : slots) {
+    // Cached candidates are committed by EndRun, without a run
+    if (s.ticket < 0 && !s.done && !tw.cache.Contains(s.candidate)) {
+      s.ticket = next_ticket++;
+      candidate = s.candidate;
+      ticket = s.ticket;
+      pruner = tw.pruner;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Coordinator::Finish(long ticket, const run_result &result) {
+  bool done = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const bool was_used = tw.is_used;
+    for (slot &s : slots) {
+      if (s.ticket == ticket) {
+        s.done = true;
+        s.result = result;
+        break;
+      }
+    }
+
+    // Commit the results in the serial order: the next candidate first
+    bool committed = true;
+    while (committed && tw.is_used) {
+      committed = false;
+      if (tw.Converged()) {
+        tw.is_used = false;
+        break;
+      }
+      std::vector<double> values = tw.Values();
+      for (const slot &s : slots) {
+        if (s.done && s.candidate == values) {
+          run_result next = s.result;
+          tw.EndRun(next, log);
+          on_end_run();
+          committed = true;
+          break;
+        }
+      }
+      if (committed) {
+        Refresh();
+      }
+    }
+    if (tw.is_used && tw.Converged()) {
+      tw.is_used = false;
+    }
+    if (!tw.is_used) {
+      slots.clear();
+      version++;
+    }
+    done = was_used && !tw.is_used;
+  }
+  if (done) {
+    on_done();
+  }
+}
+
+void Coordinator::Release(long ticket) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (slot &s : slots) {
+    if (s.ticket == ticket && !s.done) {
+      s.ticket = -1;
+    }
+  }
+}
+
+bool Coordinator::IsStale(long ticket) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const slot &s : slots) {
+    if (s.ticket == ticket) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t Coordinator::Version() const {
+  return version.load(std::memory_order_acquire);
+}
+
+bool Coordinator::IsDone() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !tw.is_used;
+}
+
+std::vector<double> Coordinator::Values() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return tw.Values();
+}
+
+void Coordinator::Refresh() {
+  if (!tw.is_used) {
+    return;
+  }
+  std::vector<std::vector<double> > candidates = tw.Candidates(simulators > 1 ? simulators : 1);
+  std::vector<slot> next;
+  for (const std::vector<double> &candidate : candidates) {
+    slot fresh = { candidate, -1, false, run_result() };
+    for (const slot &s : slots) {
+      if (s.candidate == candidate) {
+        fresh = s;
+        break;
+      }
+    }
+    next.push_back(fresh);
+  }
+  slots.swap(next);
+  version++;
+}
@@ -0,0 +1,111 @@
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "Logger.h"
+#include "Pruner.h"
+#include "RunCache.h"
+#include "Twiddle.h"
+
+/*
+* One optimization over several simulators (--farm). Each free simulator
+* gets the next candidate nobody runs yet (see Twiddle::Candidates), and the
+* results are committed in the optimizer's serial order as they come back:
+* it takes the steps it would take with a single simulator, sooner.
+* Thread-safe.
+*/
+class Coordinator {
+public:
+
+  ///* the optimization, and its log (only written under the lock)
+  Twiddle &tw;
+  Logger &log;
+
+  ///* called after each result is committed, under the lock: must not
+  ///* block the simulators (e.g. checkpoint through a CheckpointWriter)
+  std::function<void()> on_end_run;
+
+  ///* called once, when the optimization is over (e.g. to save its
+  ///* result), outside the lock
+  std::function<void()> on_done;
+
+  /*
+  * Constructor
+  */
+  Coordinator(Twiddle &tw, Logger &log);
+
+  /*
+  * Destructor.
+  */
+  virtual ~Coordinator();
+
+  /*
+  * A simulator joins / leaves the farm: as many candidates as simulators
+  * are run at once
+  */
+  void Attach();
+  void Detach();
+
+  /*
+  * Next candidate to run, its ticket and the pruner to run it with. False
+  * when the candidates known until a result comes back are all running, or
+  * when the optimization is over.
+  */
+  bool Acquire(std::vector<double> &candidate, long &ticket, Pruner &pruner);
+
+  /*
+  * Result of the candidate of ticket (ignored if it is stale)
+  */
+  void Finish(long ticket, const run_result &result);
+
+  /*
+  * Simulator gone before the end of its run: its candidate is handed out
+  * again
+  */
+  void Release(long ticket);
+
+  /*
+  * Is the candidate of ticket not needed anymore (an earlier result changed
+  * the next candidates)? Only changes when Version() does.
+  */
+  bool IsStale(long ticket);
+
+  /*
+  * Incremented whenever the candidates change (some may be stale, others
+  * free): lock-free check for the simulators, on every frame
+  */
+  uint64_t Version() const;
+
+  bool IsDone();
+
+  /*
+  * Current parameters (the best ones once done)
+  */
+  std::vector<double> Values();
+
+private:
+  struct slot {
+    std::vector<double> candidate;
+    ///* ticket of the simulator running it, -1 if none
+    long ticket;
+    bool done;
+    run_result result;
+  };
+
+  std::mutex mutex;
+  std::vector<slot> slots;
+  std::atomic<uint64_t> version;
+  long next_ticket;
+  int simulators;
+
+  /*
+  * Slots of the current candidates, keeping the running and done ones
+  */
+  void Refresh();
+};
+
+#endif /* COORDINATOR_H */
@@ -0,0 +1,60 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <cmath>
+#include <cstdint>
+
+/*
+* Signed fixed-point number with Frac fractional bits (Q(31-Frac).Frac),
+* for BasicPID on targets without a floating point unit. Products are
+* computed on 64 bits and truncated; no overflow checks.
+*/
+template<int Frac>
+struct FixedPoint {
+  int32_t raw;
+
+  FixedPoint() {}
+
+  explicit FixedPoint(double value) : raw(static_cast<int32_t>(std::lround(value * (1 << Frac)))) {}
+
+  static FixedPoint FromRaw(int32_t raw) {
+    FixedPoint value;
+    value.raw = raw;
+    return value;
+  }
+
+  double ToDouble() const {
+    return static_cast<double>(raw) / (1 << Frac);
+  }
+
+  FixedPoint operator+(FixedPoint other) const {
+    return FromRaw(raw + other.raw);
+  }
+
+  FixedPoint operator-(FixedPoint other) const {
+    return FromRaw(raw - other.raw);
+  }
+
+  FixedPoint operator*(FixedPoint other) const {
+    return FromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) * other.raw) >> Frac));
+  }
+
+  FixedPoint operator/(FixedPoint other) const {
+    return FromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) << Frac) / other.raw));
+  }
+
+  FixedPoint &operator+=(FixedPoint other) {
+    raw += other.raw;
+    return *this;
+  }
+
+  bool operator<(FixedPoint other) const {
+    return raw < other.raw;
+  }
+
+  bool operator>(FixedPoint other) const {
+    return raw > other.raw;
+  }
+};
+
+#endif /* FIXED_POINT_H */
@@ -0,0 +1,138 @@
+#include "GainSchedule.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "json.hpp"
+
+// for convenience
+using json = nlohmann::json;
+
+namespace {
+
+const int SCHEDULE_VERSION = 1;
+
+}  // namespace
+
+GainSchedule::GainSchedule() {
+  this->size = 0;
+  for (int k = 0; k < SCHEDULE_MAX_POINTS; k++) {
+    this->speed[k] = 0.0;
+    this->Kp[k] = 0.0;
+    this->Ki[k] = 0.0;
+    this->Kd[k] = 0.0;
+  }
+  Update();
+}
+
+GainSchedule::~GainSchedule() {}
+
+bool GainSchedule::Enabled() const {
+  return size > 0;
+}
+
+bool GainSchedule::Load(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open gain schedule " << path << std::endl;
+    return false;
+  }
+
+  GainSchedule loaded;
+  try {
+    json j = json::parse(in);
+    if (j["version"].get<int>() != SCHEDULE_VERSION) {
+      std::cerr << "Unsupported gain schedule version in " << path << std::endl;
+      return false;
+    }
+    const json &points = j["points"];
+    if (points.size() < 1 || points.size() > static_cast<size_t>(SCHEDULE_MAX_POINTS)) {
+      std::cerr << "Gain schedule " << path << " must have 1 to " << SCHEDULE_MAX_POINTS
+                << " breakpoints" << std::endl;
+      return false;
+    }
+    loaded.size = points.size();
+    for (int k = 0; k < loaded.size; k++) {
+      loaded.speed[k] = points[k]["speed"].get<double>();
+      loaded.Kp[k] = points[k]["Kp"].get<double>();
+      loaded.Ki[k] = points[k]["Ki"].get<double>();
+      loaded.Kd[k] = points[k]["Kd"].get<double>();
+      if (k > 0 && !(loaded.speed[k] > loaded.speed[k - 1])) {
+        std::cerr << "Gain schedule " << path << ": speeds must be increasing" << std::endl;
+        return false;
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Invalid gain schedule " << path << ": " << e.what() << std::endl;
+    return false;
+  }
+
+  *this = loaded;
+  Update();
+  return true;
+}
+
+bool GainSchedule::Save(const std::string &path) const {
+  json j;
+  j["version"] = SCHEDULE_VERSION;
+  j["points"] = json::array();
+  for (int k = 0; k < size; k++) {
+    json point;
+    point["speed"] = speed[k];
+    point["Kp"] = Kp[k];
+    point["Ki"] = Ki[k];
+    point["Kd"] = Kd[k];
+    j["points"].push_back(point);
+  }
+
+  // Same as the checkpoints: write, flush to disk, then atomically replace
+  // the previous file
+  const std::string tmp = path + ".tmp";
+  const std::string data = j.dump(2) + "\n";
+  FILE *file = fopen(tmp.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = fflush(file) == 0 && ok;
+  ok = fsync(fileno(file)) == 0 && ok;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+void GainSchedule::Lookup(double speed, double &Kp, double &Ki, double &Kd) const {
+  // Held outside the breakpoints (the argument order also maps NaN to the
+  // first one)
+  double x = std::min(std::max(this->speed[0], speed), this->speed[size - 1]);
+
+  // Segment: inner breakpoints reached, counted over the whole table (the
+  // comparisons compile to flags added up, no branch)
+  int i = 0;
+  for (int k = 1; k < SCHEDULE_MAX_POINTS; k++) {
+    i += inner[k] <= x;
+  }
+
+  double t = (x - this->speed[i]) * inverse_width[i];
+  Kp = this->Kp[i] + t * (this->Kp[i + 1] - this->Kp[i]);
+  Ki = this->Ki[i] + t * (this->Ki[i + 1] - this->Ki[i]);
+  Kd = this->Kd[i] + t * (this->Kd[i + 1] - this->Kd[i]);
+}
+
+void GainSchedule::Apply(PID &pid, double speed) const {
+  Lookup(speed, pid.Kp, pid.Ki, pid.Kd);
+}
+
+void GainSchedule::Update() {
+  // A single breakpoint is one segment of width 0, always at t = 0
+  for (int k = 0; k < SCHEDULE_MAX_POINTS; k++) {
+    inner[k] = (k > 0 && k < size - 1) ? speed[k] : INFINITY;
+    inverse_width[k] = k < size - 1 ? 1.0 / (speed[k + 1] - speed[k]) : 0.0;
+  }
+}
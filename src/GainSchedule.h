@@ -0,0 +1,78 @@
+#ifndef GAIN_SCHEDULE_H
+#define GAIN_SCHEDULE_H
+
+#include <string>
+#include "PID.h"
+
+///* most speed breakpoints of a gain schedule
+const int SCHEDULE_MAX_POINTS = 8;
+
+/*
+* PID gains by speed: Kp, Ki and Kd at each breakpoint, linearly
+* interpolated in between and held outside. Fixed size arrays, so that the
+* table stays in a few cache lines and the lookup done on every frame has no
+* data dependent branch nor loop bound. Disabled when empty.
+*/
+class GainSchedule {
+public:
+
+  ///* breakpoints used, in increasing speed order (mph)
+  int size;
+  double speed[SCHEDULE_MAX_POINTS];
+
+  ///* gains at each breakpoint (0 past size)
+  double Kp[SCHEDULE_MAX_POINTS];
+  double Ki[SCHEDULE_MAX_POINTS];
+  double Kd[SCHEDULE_MAX_POINTS];
+
+  /*
+  * Constructor
+  */
+  GainSchedule();
+
+  /*
+  * Destructor.
+  */
+  virtual ~GainSchedule();
+
+  bool Enabled() const;
+
+  /*
+  * Read the breakpoints of a schedule file (as written by Save). Prints an
+  * error and returns false if it can't be read, or the speeds aren't
+  * increasing.
+  */
+  bool Load(const std::string &path);
+
+  /*
+  * Write the schedule to a JSON file, replacing it atomically
+  */
+  bool Save(const std::string &path) const;
+
+  /*
+  * Gains at speed
+  */
+  void Lookup(double speed, double &Kp, double &Ki, double &Kd) const;
+
+  /*
+  * Set the gains of pid to the ones at speed (errors are kept)
+  */
+  void Apply(PID &pid, double speed) const;
+
+  /*
+  * Lookup tables of the breakpoint speeds, after changing size or speed
+  * (Load does). The gains can change without it, e.g. tuned by Twiddle.
+  */
+  void Update();
+
+private:
+
+  ///* speeds of the inner breakpoints (1 to size - 2), +inf elsewhere: the
+  ///* segment of a speed is the number of them it reaches
+  double inner[SCHEDULE_MAX_POINTS];
+
+  ///* 1 / width of each segment, 0 past the last one
+  double inverse_width[SCHEDULE_MAX_POINTS];
+};
+
+#endif /* GAIN_SCHEDULE_H */
@@ -0,0 +1,128 @@
+#include "GainStore.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdlib.h>
+
+GainStore::GainStore(const pid_gains &gains) : sequence(0) {
+  this->Kp.store(gains.Kp, std::memory_order_relaxed);
+  this->Ki.store(gains.Ki, std::memory_order_relaxed);
+  this->Kd.store(gains.Kd, std::memory_order_relaxed);
+  this->min_output_limit.store(gains.min_output_limit, std::memory_order_relaxed);
+  this->max_output_limit.store(gains.max_output_limit, std::memory_order_relaxed);
+}
+
+GainStore::~GainStore() {}
+
+void GainStore::Publish(const pid_gains &gains) {
+  std::lock_guard<std::mutex> lock(publish_mutex);
+
+  // Odd sequence: readers started before the end of the update retry
+  uint64_t seq = sequence.load(std::memory_order_relaxed);
+  sequence.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  Kp.store(gains.Kp, std::memory_order_relaxed);
+  Ki.store(gains.Ki, std::memory_order_relaxed);
+  Kd.store(gains.Kd, std::memory_order_relaxed);
+  min_output_limit.store(gains.min_output_limit, std::memory_order_relaxed);
+  max_output_limit.store(gains.max_output_limit, std::memory_order_relaxed);
+
+  sequence.store(seq + 2, std::memory_order_release);
+}
+
+pid_gains GainStore::Load() const {
+  pid_gains gains;
+  Read(gains);
+  return gains;
+}
+
+bool GainStore::Poll(uint64_t &version, pid_gains &gains) const {
+  if (sequence.load(std::memory_order_acquire) == version) {
+    return false;
+  }
+  version = Read(gains);
+  return true;
+}
+
+uint64_t GainStore::Read(pid_gains &gains) const {
+  while (true) {
+    uint64_t before = sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+
+    gains.Kp = Kp.load(std::memory_order_relaxed);
+    gains.Ki = Ki.load(std::memory_order_relaxed);
+    gains.Kd = Kd.load(std::memory_order_relaxed);
+    gains.min_output_limit = min_output_limit.load(std::memory_order_relaxed);
+    gains.max_output_limit = max_output_limit.load(std::memory_order_relaxed);
+
+    // Nothing published meanwhile: the copy is consistent
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) == before) {
+      return before;
+    }
+  }
+}
+
+pid_gains GetGains(const PID &pid) {
+  pid_gains gains;
+  gains.Kp = pid.Kp;
+  gains.Ki = pid.Ki;
+  gains.Kd = pid.Kd;
+  gains.min_output_limit = pid.min_output_limit;
+  gains.max_output_limit = pid.max_output_limit;
+  return gains;
+}
+
+void SetGains(PID &pid, const pid_gains &gains) {
+  pid.Kp = gains.Kp;
+  pid.Ki = gains.Ki;
+  pid.Kd = gains.Kd;
+  pid.min_output_limit = gains.min_output_limit;
+  pid.max_output_limit = gains.max_output_limit;
+}
+
+bool ParseGainsQuery(const std::string &query, pid_gains &gains) {
+  pid_gains updated = gains;
+  std::istringstream in(query);
+  std::string item;
+  while (std::getline(in, item, '&')) {
+    if (item.empty()) {
+      continue;
+    }
+    size_t equal = item.find('=');
+    if (equal == std::string::npos) {
+      return false;
+    }
+    std::string key = item.substr(0, equal);
+    std::string text = item.substr(equal + 1);
+
+    char *end;
+    double value = strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !std::isfinite(value)) {
+      return false;
+    }
+
+    if (key == "Kp") {
+      updated.Kp = value;
+    } else if (key == "Ki") {
+      updated.Ki = value;
+    } else if (key == "Kd") {
+      updated.Kd = value;
+    } else if (key == "min") {
+      updated.min_output_limit = value;
+    } else if (key == "max") {
+      updated.max_output_limit = value;
+    } else {
+      return false;
+    }
+  }
+
+  if (!(updated.min_output_limit < updated.max_output_limit)) {
+    return false;
+  }
+  gains = updated;
+  return true;
+}
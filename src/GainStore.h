@@ -0,0 +1,87 @@
+#ifndef GAIN_STORE_H
+#define GAIN_STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "PID.h"
+
+/*
+* Gains and output limits of a PID controller
+*/
+struct pid_gains {
+  double Kp;
+  double Ki;
+  double Kd;
+  double min_output_limit;
+  double max_output_limit;
+};
+
+/*
+* Gains published by any thread (operator endpoint, tuner) and picked up by
+* the control thread on its next frame. Seqlock: readers never block nor
+* write, they retry on a concurrent publish, and never see a torn block.
+*/
+class GainStore {
+public:
+
+  /*
+  * Constructor
+  */
+  GainStore(const pid_gains &gains);
+
+  /*
+  * Destructor.
+  */
+  virtual ~GainStore();
+
+  /*
+  * Make gains the current gains (publishers are serialized)
+  */
+  void Publish(const pid_gains &gains);
+
+  /*
+  * Consistent copy of the current gains
+  */
+  pid_gains Load() const;
+
+  /*
+  * If gains were published since version, copy them to gains and update
+  * version. One atomic load when nothing changed.
+  */
+  bool Poll(uint64_t &version, pid_gains &gains) const;
+
+private:
+  ///* odd while a publish is in progress
+  std::atomic<uint64_t> sequence;
+
+  std::atomic<double> Kp;
+  std::atomic<double> Ki;
+  std::atomic<double> Kd;
+  std::atomic<double> min_output_limit;
+  std::atomic<double> max_output_limit;
+
+  std::mutex publish_mutex;
+
+  uint64_t Read(pid_gains &gains) const;
+};
+
+/*
+* Gains of a controller
+*/
+pid_gains GetGains(const PID &pid);
+
+/*
+* Set the gains and limits of a controller (errors are kept)
+*/
+void SetGains(PID &pid, const pid_gains &gains);
+
+/*
+* Update gains from a query string such as "Kp=0.2&Kd=3.1&max=0.8" (keys Kp,
+* Ki, Kd, min, max; the others are unchanged). False if a key or value is
+* invalid or the limits are not min < max.
+*/
+bool ParseGainsQuery(const std::string &query, pid_gains &gains);
+
+#endif /* GAIN_STORE_H */
@@ -0,0 +1,126 @@
+#include "Logger.h"
+
+#include <chrono>
+#include <sstream>
+#include "Codec.h"
+
+Logger::Logger(std::ostream &out) : dropped(0), source(0), out(out), running(true) {
+  this->thread = std::thread(&Logger::Run, this);
+}
+
+Logger::~Logger() {
+  running.store(false, std::memory_order_release);
+  thread.join();
+}
+
+void Logger::Push(LogRecord &record) {
+  record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  record.source = source;
+  if (!ring.Push(record)) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Logger::Control(double cte, double steer_value, double throttle) {
+  LogRecord record;
+  record.type = LOG_CONTROL;
+  record.values[0] = cte;
+  record.values[1] = steer_value;
+  record.values[2] = throttle;
+  Push(record);
+}
+
+void Logger::Init() {
+  LogRecord record;
+  record.type = LOG_INIT;
+  Push(record);
+}
+
+void Logger::Run() {
+  uint64_t reported = 0;
+  LogRecord record;
+  std::ostringstream batch;
+  for (;;) {
+    // Read the flag first so that records pushed before stopping are written
+    bool stop = !running.load(std::memory_order_acquire);
+
+    bool written = false;
+    while (ring.Pop(record)) {
+      Write(record, batch);
+      written = true;
+    }
+
+    uint64_t drops = dropped.load(std::memory_order_relaxed);
+    if (drops != reported) {
+      batch << "(" << drops - reported << " log records dropped)\n";
+      reported = drops;
+      written = true;
+    }
+
+    // One write and flush per batch instead of one per line: the lines of
+    // loggers sharing out (one per worker thread) are not mixed
+    if (written) {
+      out << batch.str();
+      out.flush();
+      batch.str("");
+    }
+    if (stop) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void Logger::Write(const LogRecord &record, std::ostream &out) {
+  const double *v = record.values;
+  if (record.source != 0) {
+    out << "[" << record.source << "] ";
+  }
+  switch (record.type) {
+    case LOG_CONTROL: {
+      Message msg;
+      EncodeSteer(v[1], v[2], msg);
+      out << "CTE: " << v[0] << " Steering Value: " << v[1] << " Throttle: " << v[2] << "\n";
+      out.write(msg.data, msg.length) << "\n";
+      break;
+    }
+    case LOG_INIT:
+      out << "Initialization is done!\n";
+      break;
+    case LOG_STEP: {
+      const int n = record.count;
+      out << "p: (";
+      for (int i = 0; i < n; i++) {
+        out << (i ? ", " : "") << v[i];
+      }
+      out << "), dp: (";
+      for (int i = 0; i < n; i++) {
+        out << (i ? ", " : "") << v[n + i];
+      }
+      out << "), avg err: " << v[2*n] << ", "
+          << "dist: " << static_cast<int>(v[2*n + 1]) << "\n";
+      break;
+    }
+    case LOG_ITERATION:
+      out << "Iteration " << static_cast<int>(v[0])
+          << ", best error: " << v[1]
+          << ", best dist: "  << static_cast<int>(v[2])
+          << " --> ";
+      for (int i = 0; i < record.count; i++) {
+        out << (i ? ", " : "") << v[3 + i] << "(" << record.names[i] << ")";
+      }
+      // Cache hits / misses, when the cache is used
+      if (v[3 + record.count] + v[4 + record.count] > 0) {
+        out << ", cache: " << static_cast<long>(v[3 + record.count]) << " hits, "
+            << static_cast<long>(v[4 + record.count]) << " misses";
+      }
+      // Pruned runs and the frames they saved, when pruning
+      if (v[5 + record.count] > 0) {
+        out << ", pruned: " << static_cast<long>(v[5 + record.count]) << " runs ("
+            << static_cast<long>(v[6 + record.count]) << " frames saved)";
+      }
+      out << "\n\n";
+      break;
+  }
+}
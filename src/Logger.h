@@ -0,0 +1,72 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+#include "RingBuffer.h"
+
+enum LOG_TYPE {
+  LOG_CONTROL,
+  LOG_INIT,
+  LOG_STEP,
+  LOG_ITERATION
+};
+
+///* Twiddle records hold at most this many parameters
+const int LOG_MAX_PARAMS = 8;
+
+/*
+* Fixed-size binary log record, formatted later by the logger thread
+*/
+struct LogRecord {
+  LOG_TYPE type;
+  int source;
+  int count;
+  int64_t timestamp;
+  double values[2*LOG_MAX_PARAMS + 3];
+  char names[LOG_MAX_PARAMS][16];
+};
+
+class Logger {
+public:
+
+  ///* records pushed while the ring was full
+  std::atomic<uint64_t> dropped;
+
+  ///* tag of the records pushed from now on (session id), lines of the
+  ///* sources other than 0 are prefixed with [source]
+  int source;
+
+  /*
+  * Constructor: starts the background thread writing to out
+  */
+  Logger(std::ostream &out);
+
+  /*
+  * Destructor: writes the remaining records and stops the thread.
+  */
+  virtual ~Logger();
+
+  /*
+  * Queue a record without blocking, count it as dropped if the ring is full
+  */
+  void Push(LogRecord &record);
+
+  void Control(double cte, double steer_value, double throttle);
+
+  void Init();
+
+private:
+  std::ostream &out;
+  std::atomic<bool> running;
+  RingBuffer<LogRecord, 4096> ring;
+  std::thread thread;
+
+  void Run();
+
+  void Write(const LogRecord &record, std::ostream &out);
+};
+
+#endif /* LOGGER_H */
@@ -0,0 +1,86 @@
+#include "Metrics.h"
+
+namespace {
+
+const char *stage_names[NB_STAGES] = {
+  "parse", "pid", "twiddle", "encode", "send", "total"
+};
+
+// Prometheus bucket boundaries (seconds), folded from the fine buckets
+const double le_bounds[] = {
+  1e-7, 2.5e-7, 5e-7,
+  1e-6, 2.5e-6, 5e-6,
+  1e-5, 2.5e-5, 5e-5,
+  1e-4, 2.5e-4, 5e-4,
+  1e-3, 2.5e-3, 5e-3,
+  1e-2, 2.5e-2, 5e-2,
+  1e-1, 2.5e-1, 5e-1,
+  1.0
+};
+
+}  // namespace
+
+Histogram::Histogram() : sum(0) {
+  for (int i = 0; i < NB_BUCKETS; i++) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t Histogram::UpperBound(int index) {
+  int shift = index < SUB_BUCKETS ? 0 : index / SUB_BUCKETS - 1;
+  uint64_t m = index - shift * SUB_BUCKETS;
+  return (m + 1) << shift;
+}
+
+uint64_t Histogram::Collect(uint64_t *counts) const {
+  for (int i = 0; i < NB_BUCKETS; i++) {
+    counts[i] += buckets[i].load(std::memory_order_relaxed);
+  }
+  return sum.load(std::memory_order_relaxed);
+}
+
+Metrics::Metrics() : coalesced(0) {}
+
+Metrics::~Metrics() {}
+
+void Metrics::Write(std::ostream &out) const {
+  Write(out, std::vector<const Metrics*>(1, this));
+}
+
+void Metrics::Write(std::ostream &out, const std::vector<const Metrics*> &metrics) {
+  out << "# HELP pid2_frame_seconds Telemetry handler time, receive to send, per stage.\n";
+  out << "# TYPE pid2_frame_seconds histogram\n";
+
+  for (int s = 0; s < NB_STAGES; s++) {
+    uint64_t counts[Histogram::NB_BUCKETS] = {0};
+    uint64_t sum = 0;
+    for (const Metrics *m : metrics) {
+      sum += m->stages[s].Collect(counts);
+    }
+
+    // A fine bucket goes to the first boundary its upper bound fits under
+    uint64_t cumulative = 0;
+    int i = 0;
+    for (double le : le_bounds) {
+      while (i < Histogram::NB_BUCKETS && Histogram::UpperBound(i) <= le * 1e9) {
+        cumulative += counts[i++];
+      }
+      out << "pid2_frame_seconds_bucket{stage=\"" << stage_names[s] << "\",le=\"" << le << "\"} "
+          << cumulative << "\n";
+    }
+    while (i < Histogram::NB_BUCKETS) {
+      cumulative += counts[i++];
+    }
+    out << "pid2_frame_seconds_bucket{stage=\"" << stage_names[s] << "\",le=\"+Inf\"} " << cumulative << "\n";
+    out << "pid2_frame_seconds_sum{stage=\"" << stage_names[s] << "\"} " << sum * 1e-9 << "\n";
+    out << "pid2_frame_seconds_count{stage=\"" << stage_names[s] << "\"} " << cumulative << "\n";
+  }
+
+  uint64_t coalesced = 0;
+  for (const Metrics *m : metrics) {
+    coalesced += m->coalesced.load(std::memory_order_relaxed);
+  }
+  out << "# HELP pid2_coalesced_frames_total Telemetry frames skipped for a newer one (--coalesce).\n";
+  out << "# TYPE pid2_coalesced_frames_total counter\n";
+  out << "pid2_coalesced_frames_total " << coalesced << "\n";
+}
@@ -0,0 +1,114 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/*
+* Steps of the telemetry handler, from receiving a frame to sending the reply
+*/
+enum STAGE {
+  STAGE_PARSE,
+  STAGE_PID,
+  STAGE_TWIDDLE,
+  STAGE_ENCODE,
+  STAGE_SEND,
+  STAGE_TOTAL,
+  NB_STAGES
+};
+
+/*
+* Log-linear (HDR-style) histogram of durations in nanoseconds: 16 linear
+* sub-buckets per power of 2, i.e. ~6% precision from 1ns up to ~18 minutes.
+* Written by a single thread without locks, readable from any thread.
+*/
+class Histogram {
+public:
+  static const int SUB_BITS = 4;
+  static const int SUB_BUCKETS = 1 << SUB_BITS;
+  static const int MAX_BITS = 40;
+  static const int NB_BUCKETS = (MAX_BITS - SUB_BITS) * SUB_BUCKETS + SUB_BUCKETS;
+
+  Histogram();
+
+  void Record(uint64_t ns) {
+    if (ns >= (uint64_t(1) << MAX_BITS)) {
+      ns = (uint64_t(1) << MAX_BITS) - 1;
+    }
+    int i = Index(ns);
+    // Single writer: plain load + store, no read-modify-write needed
+    buckets[i].store(buckets[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+  }
+
+  static int Index(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+      return static_cast<int>(ns);
+    }
+    int shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+    return shift * SUB_BUCKETS + static_cast<int>(ns >> shift);
+  }
+
+  /*
+  * Exclusive upper bound (ns) of a bucket
+  */
+  static uint64_t UpperBound(int index);
+
+  /*
+  * Add the counts of this histogram to counts[NB_BUCKETS], return the sum
+  */
+  uint64_t Collect(uint64_t *counts) const;
+
+private:
+  std::atomic<uint64_t> buckets[NB_BUCKETS];
+  std::atomic<uint64_t> sum;
+};
+
+class Metrics {
+public:
+
+  ///* telemetry handler durations, per stage
+  Histogram stages[NB_STAGES];
+
+  ///* frames not replied to because a newer one was received (single writer)
+  std::atomic<uint64_t> coalesced;
+
+  /*
+  * Constructor
+  */
+  Metrics();
+
+  /*
+  * Destructor.
+  */
+  virtual ~Metrics();
+
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /*
+  * Record the time spent in a stage since t, and move t to now
+  */
+  void Lap(STAGE stage, uint64_t &t) {
+    uint64_t now = Now();
+    stages[stage].Record(now - t);
+    t = now;
+  }
+
+  /*
+  * Write all histograms in the Prometheus text format
+  */
+  void Write(std::ostream &out) const;
+
+  /*
+  * Write the sum of the histograms of several Metrics (one per thread)
+  */
+  static void Write(std::ostream &out, const std::vector<const Metrics*> &metrics);
+};
+
+#endif /* METRICS_H */
@@ -0,0 +1,212 @@
+#include "NelderMead.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Reflection, expansion, contraction and shrink coefficients
+static const double ALPHA = 1.0;
+static const double GAMMA = 2.0;
+static const double RHO = 0.5;
+static const double SIGMA = 0.5;
+
+// Converged when the simplex is this small (in initial steps)
+static const double TOLERANCE = 1E-6;
+
+NelderMead::NelderMead(const std::vector<double> &values, const std::vector<double> &steps, int budget) {
+  this->origin = values;
+  this->steps = steps;
+  this->budget = budget;
+  this->evaluations = 0;
+  this->iteration = 0;
+  this->best_cost = INFINITY;
+  this->reflected_cost = INFINITY;
+
+  // Start point, then one step along each parameter
+  size_t n = values.size();
+  for (size_t i = 0; i <= n; i++) {
+    std::vector<double> point(n, 0.0);
+    if (i > 0) {
+      point[i - 1] = 1.0;
+    }
+    simplex.push_back(point);
+  }
+  costs.assign(n + 1, INFINITY);
+  this->phase = PHASE_INIT;
+  this->vertex = 0;
+  this->candidate = simplex[0];
+}
+
+NelderMead::~NelderMead() {}
+
+std::vector<double> NelderMead::Values(const std::vector<double> &point) const {
+  std::vector<double> values(point.size());
+  for (size_t j = 0; j < point.size(); j++) {
+    values[j] = origin[j] + steps[j] * point[j];
+  }
+  return values;
+}
+
+std::vector<double> NelderMead::Along(const std::vector<double> &from, const std::vector<double> &to,
+                                      double factor) const {
+  // from + factor * (to - from)
+  std::vector<double> point(from.size());
+  for (size_t j = 0; j < from.size(); j++) {
+    point[j] = from[j] + factor * (to[j] - from[j]);
+  }
+  return point;
+}
+
+std::vector<double> NelderMead::Ask() const {
+  return Values(candidate);
+}
+
+std::vector<std::vector<double> > NelderMead::Batch() const {
+  std::vector<std::vector<double> > batch;
+  if (phase == PHASE_INIT || phase == PHASE_SHRINK) {
+    // The remaining vertices don't depend on the costs
+    for (size_t i = vertex; i < simplex.size(); i++) {
+      batch.push_back(Values(simplex[i]));
+    }
+  } else {
+    batch.push_back(Ask());
+  }
+  return batch;
+}
+
+void NelderMead::Tell(double cost) {
+  evaluations++;
+  if (cost < best_cost) {
+    best_cost = cost;
+    best = Values(candidate);
+  }
+
+  size_t n = simplex.size() - 1;
+  switch (phase) {
+    case PHASE_INIT:
+    case PHASE_SHRINK:
+      costs[vertex++] = cost;
+      if (static_cast<size_t>(vertex) <= n) {
+        candidate = simplex[vertex];
+        return;
+      }
+      break;
+    case PHASE_REFLECT:
+      reflected = candidate;
+      reflected_cost = cost;
+      if (cost < costs[0]) {
+        // Better than the best: try further
+        phase = PHASE_EXPAND;
+        candidate = Along(centroid, reflected, GAMMA);
+        return;
+      }
+      if (cost < costs[n - 1]) {
+        Replace(reflected, cost);
+        break;
+      }
+      if (cost < costs[n]) {
+        phase = PHASE_CONTRACT_OUTSIDE;
+        candidate = Along(centroid, reflected, RHO);
+      } else {
+        phase = PHASE_CONTRACT_INSIDE;
+        candidate = Along(centroid, simplex[n], RHO);
+      }
+      return;
+    case PHASE_EXPAND:
+      if (cost < reflected_cost) {
+        Replace(candidate, cost);
+      } else {
+        Replace(reflected, reflected_cost);
+      }
+      break;
+    case PHASE_CONTRACT_OUTSIDE:
+    case PHASE_CONTRACT_INSIDE: {
+      double bound = phase == PHASE_CONTRACT_OUTSIDE ? reflected_cost : costs[n];
+      if (cost <= bound) {
+        Replace(candidate, cost);
+        break;
+      }
+      // Shrink towards the best vertex, then evaluate the new vertices
+      for (size_t i = 1; i <= n; i++) {
+        simplex[i] = Along(simplex[0], simplex[i], SIGMA);
+      }
+      phase = PHASE_SHRINK;
+      vertex = 1;
+      candidate = simplex[1];
+      return;
+    }
+  }
+
+  if (phase != PHASE_INIT) {
+    iteration++;
+  }
+  StartIteration();
+}
+
+void NelderMead::Replace(const std::vector<double> &point, double cost) {
+  size_t n = simplex.size() - 1;
+  simplex[n] = point;
+  costs[n] = cost;
+}
+
+void NelderMead::StartIteration() {
+  size_t n = simplex.size() - 1;
+
+  // Sort the vertices by cost
+  std::vector<size_t> order(n + 1);
+  for (size_t i = 0; i <= n; i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return costs[a] < costs[b]; });
+  std::vector<std::vector<double> > sorted_simplex;
+  std::vector<double> sorted_costs;
+  for (size_t i : order) {
+    sorted_simplex.push_back(simplex[i]);
+    sorted_costs.push_back(costs[i]);
+  }
+  simplex.swap(sorted_simplex);
+  costs.swap(sorted_costs);
+
+  centroid.assign(n, 0.0);
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j = 0; j < n; j++) {
+      centroid[j] += simplex[i][j] / n;
+    }
+  }
+
+  phase = PHASE_REFLECT;
+  candidate = Along(centroid, simplex[n], -ALPHA);
+}
+
+bool NelderMead::Done() const {
+  if (evaluations >= budget) {
+    return true;
+  }
+  if (phase == PHASE_INIT) {
+    return false;
+  }
+  double size = 0.0;
+  for (size_t i = 1; i < simplex.size(); i++) {
+    for (size_t j = 0; j < simplex[i].size(); j++) {
+      size = std::max(size, fabs(simplex[i][j] - simplex[0][j]));
+    }
+  }
+  return size < TOLERANCE;
+}
+
+std::vector<double> NelderMead::Best() const {
+  return best.empty() ? Values(simplex[0]) : best;
+}
+
+std::vector<double> NelderMead::Spread() const {
+  std::vector<double> spread(steps.size(), 0.0);
+  for (size_t i = 1; i < simplex.size(); i++) {
+    for (size_t j = 0; j < spread.size(); j++) {
+      spread[j] = std::max(spread[j], steps[j] * fabs(simplex[i][j] - simplex[0][j]));
+    }
+  }
+  return spread;
+}
+
+int NelderMead::Iteration() const {
+  return iteration;
+}
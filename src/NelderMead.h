@@ -0,0 +1,86 @@
+#ifndef NELDER_MEAD_H
+#define NELDER_MEAD_H
+
+#include <vector>
+#include "Optimizer.h"
+
+/*
+* Nelder-Mead simplex search, in coordinates scaled by the initial steps
+* (the first simplex is the start point and one step along each parameter).
+*/
+class NelderMead : public Optimizer {
+public:
+
+  /*
+  * Constructor
+  */
+  NelderMead(const std::vector<double> &values, const std::vector<double> &steps, int budget);
+
+  /*
+  * Destructor.
+  */
+  virtual ~NelderMead();
+
+  std::vector<double> Ask() const;
+
+  void Tell(double cost);
+
+  std::vector<std::vector<double> > Batch() const;
+
+  bool Done() const;
+
+  std::vector<double> Best() const;
+
+  std::vector<double> Spread() const;
+
+  int Iteration() const;
+
+private:
+  enum PHASE {
+    PHASE_INIT,
+    PHASE_REFLECT,
+    PHASE_EXPAND,
+    PHASE_CONTRACT_OUTSIDE,
+    PHASE_CONTRACT_INSIDE,
+    PHASE_SHRINK
+  };
+
+  ///* start point and scale of each coordinate
+  std::vector<double> origin;
+  std::vector<double> steps;
+
+  ///* n+1 vertices (scaled coordinates) and their costs
+  std::vector<std::vector<double> > simplex;
+  std::vector<double> costs;
+
+  PHASE phase;
+
+  ///* vertex evaluated next (init and shrink phases)
+  int vertex;
+
+  ///* centroid of all vertices but the worst, reflected point and its cost
+  std::vector<double> centroid;
+  std::vector<double> reflected;
+  double reflected_cost;
+
+  ///* point to evaluate next
+  std::vector<double> candidate;
+
+  std::vector<double> best;
+  double best_cost;
+
+  int evaluations;
+  int budget;
+  int iteration;
+
+  std::vector<double> Values(const std::vector<double> &point) const;
+
+  std::vector<double> Along(const std::vector<double> &from, const std::vector<double> &to,
+                            double factor) const;
+
+  void Replace(const std::vector<double> &point, double cost);
+
+  void StartIteration();
+};
+
+#endif /* NELDER_MEAD_H */
@@ -0,0 +1,37 @@
+#include "Optimizer.h"
+
+#include "BayesOpt.h"
+#include "CMAES.h"
+#include "NelderMead.h"
+
+Optimizer::~Optimizer() {}
+
+std::vector<std::vector<double> > Optimizer::Batch() const {
+  return std::vector<std::vector<double> >(1, Ask());
+}
+
+double RunCost(const run_result &result, int max_dist) {
+  if (result.dist >= max_dist) {
+    return result.avg_error;
+  }
+  // avg squared cte is below 16 (|cte| < 4) on a run that didn't leave the road
+  return 16.0 + 16.0 * (max_dist - result.dist) / max_dist + result.avg_error;
+}
+
+bool IsOptimizer(const std::string &name) {
+  return name == "twiddle" || name == "nelder-mead" || name == "cma-es" || name == "bayes";
+}
+
+Optimizer *MakeOptimizer(const std::string &name, const std::vector<double> &values,
+                         const std::vector<double> &steps, int budget) {
+  if (name == "nelder-mead") {
+    return new NelderMead(values, steps, budget);
+  }
+  if (name == "cma-es") {
+    return new CMAES(values, steps, budget);
+  }
+  if (name == "bayes") {
+    return new BayesOpt(values, steps, budget);
+  }
+  return nullptr;
+}
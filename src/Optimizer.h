@@ -0,0 +1,78 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include "RunCache.h"
+
+/*
+* Black-box search over the tuned parameters (ask / tell): the driver runs
+* an episode with Ask(), gives its cost to Tell(), and so on until Done().
+* Twiddle's coordinate descent is built in (Twiddle.h), the optimizers
+* below replace it when selected with --optimizer.
+*/
+class Optimizer {
+public:
+
+  /*
+  * Destructor.
+  */
+  virtual ~Optimizer();
+
+  /*
+  * Candidate to run next (values in parameter order). Doesn't change the
+  * state: the same candidate is returned until Tell().
+  */
+  virtual std::vector<double> Ask() const = 0;
+
+  /*
+  * Cost of the candidate returned by Ask() (lower is better)
+  */
+  virtual void Tell(double cost) = 0;
+
+  /*
+  * Candidates that will be asked next whatever the costs of the first
+  * ones, starting with Ask() (e.g. a whole CMA-ES generation): they can be
+  * run in parallel.
+  */
+  virtual std::vector<std::vector<double> > Batch() const;
+
+  /*
+  * Converged, or the episode budget is spent
+  */
+  virtual bool Done() const = 0;
+
+  /*
+  * Best candidate told so far
+  */
+  virtual std::vector<double> Best() const = 0;
+
+  /*
+  * Current search scale of each parameter (logged like Twiddle's dp)
+  */
+  virtual std::vector<double> Spread() const = 0;
+
+  /*
+  * Completed iterations (simplex steps, generations, evaluations...)
+  */
+  virtual int Iteration() const = 0;
+};
+
+/*
+* Cost of an episode, shared by the optimizers: runs that leave the road
+* before max_dist cost more than any complete run, the shorter the worse;
+* complete runs cost their avg squared cte.
+*/
+double RunCost(const run_result &result, int max_dist);
+
+bool IsOptimizer(const std::string &name);
+
+/*
+* Optimizer by name (nelder-mead, cma-es, bayes), starting from values with
+* initial steps (Twiddle's initial dp), spending at most budget episodes.
+* nullptr for twiddle (built in).
+*/
+Optimizer *MakeOptimizer(const std::string &name, const std::vector<double> &values,
+                         const std::vector<double> &steps, int budget);
+
+#endif /* OPTIMIZER_H */
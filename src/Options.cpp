@@ -0,0 +1,195 @@
+#include "Options.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include "Optimizer.h"
+#include "Parameters.h"
+
+namespace {
+
+std::vector<std::string> Split(const std::string &s, char separator) {
+  std::vector<std::string> items;
+  std::istringstream in(s);
+  std::string item;
+  while (std::getline(in, item, separator)) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+}  // namespace
+
+Options::Options() {
+  this->max_dist = -1;
+  this->Kp = 0.0;
+  this->Ki = 0.0;
+  this->Kd = 0.0;
+  this->tune = { "Kp", "Ki", "Kd" };
+  this->optimizer = "twiddle";
+  this->budget = 200;
+  this->breakpoint = -1;
+  this->threads = 0;
+  this->cache = 0.0;
+  this->prune = 0.0;
+  this->coalesce = false;
+  this->farm = false;
+  this->sims = 0;
+  this->port = 4567;
+  this->ports = 1;
+}
+
+bool ParseOptions(int argc, char *argv[], Options &options) {
+  int position = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+
+    if (arg.compare(0, 2, "--") != 0) {
+      // Positional arguments: max_dist, Kp, Ki, Kd
+      switch (position++) {
+        case 0: options.max_dist = atoi(argv[i]); break;
+        case 1: options.Kp = atof(argv[i]); break;
+        case 2: options.Ki = atof(argv[i]); break;
+        case 3: options.Kd = atof(argv[i]); break;
+        default:
+          std::cerr << "Unexpected argument: " << arg << std::endl;
+          return false;
+      }
+      continue;
+    }
+
+    // Flags (no value)
+    if (arg == "--coalesce") {
+      options.coalesce = true;
+      continue;
+    }
+    if (arg == "--farm") {
+      options.farm = true;
+      continue;
+    }
+
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+
+    if (arg == "--tune") {
+      options.tune = Split(value, ',');
+      if (options.tune.empty()) {
+        std::cerr << "--tune needs at least one parameter (Kp, Ki, Kd, throttle)" << std::endl;
+        return false;
+      }
+      for (size_t i = 0; i < options.tune.size(); i++) {
+        const std::string &name = options.tune[i];
+        if (!IsParameter(name)) {
+          std::cerr << "Unknown parameter to tune: " << name << std::endl;
+          return false;
+        }
+        // Twiddle would change the same value twice
+        for (size_t j = 0; j < i; j++) {
+          if (options.tune[j] == name) {
+            std::cerr << "Parameter tuned twice: " << name << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+    else if (arg == "--optimizer") {
+      if (!IsOptimizer(value)) {
+        std::cerr << "Unknown optimizer: " << value << " (twiddle, nelder-mead, cma-es, bayes)" << std::endl;
+        return false;
+      }
+      options.optimizer = value;
+    }
+    else if (arg == "--budget") {
+      options.budget = atoi(value.c_str());
+    }
+    else if (arg == "--schedule") {
+      options.schedule = value;
+    }
+    else if (arg == "--breakpoint") {
+      options.breakpoint = atoi(value.c_str());
+    }
+    else if (arg == "--threads") {
+      options.threads = atoi(value.c_str());
+    }
+    else if (arg == "--sims") {
+      options.sims = atoi(value.c_str());
+    }
+    else if (arg == "--port") {
+      options.port = atoi(value.c_str());
+    }
+    else if (arg == "--ports") {
+      options.ports = atoi(value.c_str());
+      if (options.ports < 1) {
+        std::cerr << "--ports must be at least 1" << std::endl;
+        return false;
+      }
+    }
+    else if (arg == "--cache") {
+      options.cache = atof(value.c_str());
+    }
+    else if (arg == "--prune") {
+      options.prune = atof(value.c_str());
+      if (options.prune < 0.0 || options.prune >= 1.0) {
+        std::cerr << "--prune confidence must be in [0, 1)" << std::endl;
+        return false;
+      }
+    }
+    else if (arg == "--replay") {
+      options.replay = Split(value, ',');
+    }
+    else if (arg == "--checkpoint") {
+      options.checkpoint = value;
+    }
+    else if (arg == "--resume") {
+      options.resume = value;
+    }
+    else if (arg == "--trace") {
+      options.trace = value;
+    }
+    else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return false;
+    }
+  }
+
+  // Checkpoints hold the coordinate descent state only
+  if (options.optimizer != "twiddle" && !(options.checkpoint.empty() && options.resume.empty())) {
+    std::cerr << "--checkpoint and --resume are only supported with --optimizer twiddle" << std::endl;
+    return false;
+  }
+
+  // Gain schedule: Twiddle tunes the gains of one breakpoint at a time
+  if (!options.schedule.empty()) {
+    if (!options.gain_schedule.Load(options.schedule)) {
+      return false;
+    }
+    if (options.breakpoint >= options.gain_schedule.size) {
+      std::cerr << "--breakpoint must be below " << options.gain_schedule.size
+                << " (breakpoints of " << options.schedule << ")" << std::endl;
+      return false;
+    }
+    bool tunes_gains = false;
+    for (const std::string &name : options.tune) {
+      tunes_gains = tunes_gains || name != "throttle";
+    }
+    if (options.max_dist > 0 && tunes_gains && options.breakpoint < 0) {
+      std::cerr << "--schedule: choose the breakpoint to tune with --breakpoint k" << std::endl;
+      return false;
+    }
+    // Candidates are replayed with fixed gains
+    if (!options.replay.empty()) {
+      std::cerr << "--replay is not supported with --schedule" << std::endl;
+      return false;
+    }
+  }
+  else if (options.breakpoint >= 0) {
+    std::cerr << "--breakpoint needs a gain schedule (--schedule path)" << std::endl;
+    return false;
+  }
+  return true;
+}
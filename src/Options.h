@@ -0,0 +1,82 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <vector>
+#include "GainSchedule.h"
+
+/*
+* Command line: [max_dist] [Kp] [Ki] [Kd] [--option value]...
+*/
+struct Options {
+  ///* maximum distance of a Twiddle run, -1 to not use Twiddle
+  int max_dist;
+
+  ///* initial PID gains
+  double Kp;
+  double Ki;
+  double Kd;
+
+  ///* parameters optimized by Twiddle (--tune Kp,Ki,Kd)
+  std::vector<std::string> tune;
+
+  ///* search over the tuned parameters (--optimizer twiddle, nelder-mead,
+  ///* cma-es or bayes) and its maximum number of runs (--budget N), not
+  ///* used by twiddle
+  std::string optimizer;
+  int budget;
+
+  ///* gains by speed instead of Kp, Ki and Kd (--schedule path, loaded
+  ///* by ParseOptions), and its breakpoint whose gains Twiddle tunes
+  ///* (--breakpoint k, -1 if none)
+  std::string schedule;
+  GainSchedule gain_schedule;
+  int breakpoint;
+
+  ///* worker threads (--threads N)
+  int threads;
+
+  ///* reuse the score of parameters closer than this to a previous run,
+  ///* 0 to always run (--cache tolerance)
+  double cache;
+
+  ///* confidence to stop a run that can't beat the best one early, 0 to
+  ///* always run the whole distance (--prune confidence)
+  double prune;
+
+  ///* traces pid_tune scores the candidates on, instead of the vehicle
+  ///* model (--replay path[,path...])
+  std::vector<std::string> replay;
+
+  ///* Twiddle state saved after every run (--checkpoint path)
+  std::string checkpoint;
+
+  ///* Twiddle state to start from (--resume path)
+  std::string resume;
+
+  ///* binary file every telemetry frame is appended to (--trace path)
+  std::string trace;
+
+  ///* one optimization over all the connected simulators (--farm), and the
+  ///* simulators pid_tune simulates for it (--sims N)
+  bool farm;
+  int sims;
+
+  ///* simulators connect to ports port to port + ports - 1 (--port P,
+  ///* --ports N)
+  int port;
+  int ports;
+
+  ///* reply only to the newest of the frames received together (--coalesce)
+  bool coalesce;
+
+  Options();
+};
+
+/*
+* Parse the command line into options (keeping their defaults for anything
+* not given). Prints an error and returns false on invalid arguments.
+*/
+bool ParseOptions(int argc, char *argv[], Options &options);
+
+#endif /* OPTIONS_H */
@@ -1,52 +1,177 @@
 #ifndef PID_H
 #define PID_H
 
-class PID {
+/*
+* Terms of the controller (bit mask)
+*/
+enum PID_TERMS {
+  PID_TERMS_P = 1,
+  PID_TERMS_I = 2,
+  PID_TERMS_D = 4,
+  PID_TERMS_PI = PID_TERMS_P | PID_TERMS_I,
+  PID_TERMS_PD = PID_TERMS_P | PID_TERMS_D,
+  PID_TERMS_PID = PID_TERMS_P | PID_TERMS_I | PID_TERMS_D
+};
+
+/*
+* Clamp policies: integral and output limited to [min, max], or not limited
+*/
+struct ClampOutput {
+  template<typename T>
+  static void Apply(T &value, T min, T max) {
+    if (value > max) {
+      value = max;
+    }
+    if (value < min) {
+      value = min;
+    }
+  }
+};
+
+struct NoClamp {
+  template<typename T>
+  static void Apply(T &, T, T) {}
+};
+
+/*
+* Gains set at run time (Init, or through Kp/Ki/Kd, e.g. by Twiddle).
+* For gains known at compile time, use instead a struct with
+* static constexpr T Kp, Ki and Kd members.
+*/
+template<typename T>
+struct RuntimeGains {
+  T Kp;
+  T Ki;
+  T Kd;
+
+  void SetGains(T Kp, T Ki, T Kd) {
+    this->Kp = Kp;
+    this->Ki = Ki;
+    this->Kd = Kd;
+  }
+};
+
+/*
+* PID controller. T is the scalar type (float, double, FixedPoint), the
+* disabled terms and the clamps of NoClamp compile away.
+*/
+template<typename T, int Terms = PID_TERMS_PID, typename ClampPolicy = ClampOutput,
+         typename Gains = RuntimeGains<T> >
+class BasicPID : public Gains {
 public:
   /*
   * Errors
   */
-  double p_error;
-  double i_error;
-  double d_error;
-
-  /*
-  * Coefficients
-  */
-  double Kp;
-  double Ki;
-  double Kd;
+  T p_error;
+  T i_error;
+  T d_error;
 
   /*
   * Output limits (steering values)
   */
-  double min_output_limit = -1.0;
-  double max_output_limit = 1.0;
+  T min_output_limit = T(-1.0);
+  T max_output_limit = T(1.0);
 
   /*
-  * Constructor
+  * Initialize PID.
   */
-  PID();
+  void Init(T Kp, T Ki, T Kd);
 
   /*
-  * Destructor.
+  * Reset the errors (gains known at compile time).
   */
-  virtual ~PID();
+  void Init();
 
   /*
-  * Initialize PID.
+  * Update the PID error variables given cross track error.
   */
-  void Init(double Kp, double Ki, double Kd);
+  void UpdateError(T cte);
 
   /*
-  * Update the PID error variables given cross track error.
+  * Update the errors given the cross track error frames frame periods after
+  * the previous update (frames skipped), and cte_sum, the sum of the cross
+  * track errors of those frames (cte included): derivative per frame period,
+  * integral of every frame (clamped once).
   */
-  void UpdateError(double cte);
+  void UpdateError(T cte, int frames, T cte_sum);
 
   /*
   * Calculate the total PID error.
   */
-  double TotalError();
+  T TotalError();
 };
 
+template<typename T, int Terms, typename ClampPolicy, typename Gains>
+void BasicPID<T, Terms, ClampPolicy, Gains>::Init(T Kp, T Ki, T Kd) {
+  this->SetGains(Kp, Ki, Kd);
+  Init();
+}
+
+template<typename T, int Terms, typename ClampPolicy, typename Gains>
+void BasicPID<T, Terms, ClampPolicy, Gains>::Init() {
+  this->p_error = T(0);
+  this->i_error = T(0);
+  this->d_error = T(0);
+}
+
+template<typename T, int Terms, typename ClampPolicy, typename Gains>
+void BasicPID<T, Terms, ClampPolicy, Gains>::UpdateError(T cte) {
+  // differential: current cte - previous cte
+  if (Terms & PID_TERMS_D) {
+    d_error = cte - p_error;
+  }
+  // proportionnal: current cte (also the previous cte of the D term)
+  p_error = cte;
+  // integral: sum of cte
+  if (Terms & PID_TERMS_I) {
+    i_error += cte;
+
+    // Handle integral windup problem by setting output limits
+    ClampPolicy::Apply(i_error, min_output_limit, max_output_limit);
+  }
+}
+
+template<typename T, int Terms, typename ClampPolicy, typename Gains>
+void BasicPID<T, Terms, ClampPolicy, Gains>::UpdateError(T cte, int frames, T cte_sum) {
+  if (frames <= 1) {
+    UpdateError(cte);
+    return;
+  }
+  if (Terms & PID_TERMS_D) {
+    d_error = (cte - p_error) / T(frames);
+  }
+  p_error = cte;
+  if (Terms & PID_TERMS_I) {
+    i_error += cte_sum;
+    ClampPolicy::Apply(i_error, min_output_limit, max_output_limit);
+  }
+}
+
+template<typename T, int Terms, typename ClampPolicy, typename Gains>
+T BasicPID<T, Terms, ClampPolicy, Gains>::TotalError() {
+  // Kp*p_error + Ki*i_error + Kd*d_error, left to right, enabled terms only
+  T total_error = T(0);
+  if (Terms & PID_TERMS_P) {
+    total_error = this->Kp*p_error;
+  }
+  if (Terms & PID_TERMS_I) {
+    total_error = (Terms & PID_TERMS_P) ? total_error + this->Ki*i_error : this->Ki*i_error;
+  }
+  if (Terms & PID_TERMS_D) {
+    total_error = (Terms & PID_TERMS_PI) ? total_error + this->Kd*d_error : this->Kd*d_error;
+  }
+
+  // Handle windup problem by setting output limits
+  ClampPolicy::Apply(total_error, min_output_limit, max_output_limit);
+
+  return total_error;
+}
+
+/*
+* Runtime gains, all terms, clamped: compiled once in PID.cpp
+*/
+typedef BasicPID<double, PID_TERMS_PID, ClampOutput> PID;
+
+extern template class BasicPID<double, PID_TERMS_PID, ClampOutput>;
+
 #endif /* PID_H */
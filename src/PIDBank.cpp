@@ -0,0 +1,232 @@
+#include "PIDBank.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PID_BANK_X86
+#include <immintrin.h>
+#endif
+
+// Arrays are padded to a cache line (8 doubles)
+static const size_t ALIGNMENT = 64;
+static const size_t NB_ARRAYS = 8;
+
+namespace {
+
+// Same operations and order as PID::UpdateError / PID::TotalError. Clamping
+// with min/max keeps the semantic of the two ifs: min(max, x) returns x
+// unless max < x (also when x is NaN), max(min, x) returns x unless min > x.
+// Products and sums must not be fused (FMA, implied by avx512f): this file is
+// compiled with -ffp-contract=off, like PID.cpp.
+
+void UpdateErrorScalar(size_t begin, size_t end, const double *cte,
+                       double *p_error, double *i_error, double *d_error,
+                       const double *min_limit, const double *max_limit) {
+  for (size_t k = begin; k < end; k++) {
+    d_error[k] = cte[k] - p_error[k];
+    p_error[k] = cte[k];
+    double i = i_error[k] + cte[k];
+    if (i > max_limit[k]) {
+      i = max_limit[k];
+    }
+    if (i < min_limit[k]) {
+      i = min_limit[k];
+    }
+    i_error[k] = i;
+  }
+}
+
+void TotalErrorScalar(size_t begin, size_t end, double *out,
+                      const double *p_error, const double *i_error, const double *d_error,
+                      const double *Kp, const double *Ki, const double *Kd,
+                      const double *min_limit, const double *max_limit) {
+  for (size_t k = begin; k < end; k++) {
+    double total_error = Kp[k]*p_error[k] + Ki[k]*i_error[k] + Kd[k]*d_error[k];
+    if (total_error > max_limit[k]) {
+      total_error = max_limit[k];
+    }
+    if (total_error < min_limit[k]) {
+      total_error = min_limit[k];
+    }
+    out[k] = total_error;
+  }
+}
+
+#ifdef PID_BANK_X86
+
+__attribute__((target("avx2")))
+size_t UpdateErrorAVX2(size_t n, const double *cte,
+                       double *p_error, double *i_error, double *d_error,
+                       const double *min_limit, const double *max_limit) {
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    __m256d c = _mm256_loadu_pd(cte + k);
+    __m256d p = _mm256_load_pd(p_error + k);
+    __m256d i = _mm256_add_pd(_mm256_load_pd(i_error + k), c);
+    i = _mm256_min_pd(_mm256_load_pd(max_limit + k), i);
+    i = _mm256_max_pd(_mm256_load_pd(min_limit + k), i);
+    _mm256_store_pd(d_error + k, _mm256_sub_pd(c, p));
+    _mm256_store_pd(p_error + k, c);
+    _mm256_store_pd(i_error + k, i);
+  }
+  return k;
+}
+
+__attribute__((target("avx2")))
+size_t TotalErrorAVX2(size_t n, double *out,
+                      const double *p_error, const double *i_error, const double *d_error,
+                      const double *Kp, const double *Ki, const double *Kd,
+                      const double *min_limit, const double *max_limit) {
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    __m256d t = _mm256_add_pd(_mm256_mul_pd(_mm256_load_pd(Kp + k), _mm256_load_pd(p_error + k)),
+                              _mm256_mul_pd(_mm256_load_pd(Ki + k), _mm256_load_pd(i_error + k)));
+    t = _mm256_add_pd(t, _mm256_mul_pd(_mm256_load_pd(Kd + k), _mm256_load_pd(d_error + k)));
+    t = _mm256_min_pd(_mm256_load_pd(max_limit + k), t);
+    t = _mm256_max_pd(_mm256_load_pd(min_limit + k), t);
+    _mm256_storeu_pd(out + k, t);
+  }
+  return k;
+}
+
+// Compare and blend (max < x ? max : x, then min > x ? min : x)
+__attribute__((target("avx512f")))
+inline __m512d Clamp512(__m512d x, __m512d min, __m512d max) {
+  x = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(max, x, _CMP_LT_OQ), x, max);
+  return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(min, x, _CMP_GT_OQ), x, min);
+}
+
+__attribute__((target("avx512f")))
+size_t UpdateErrorAVX512(size_t n, const double *cte,
+                         double *p_error, double *i_error, double *d_error,
+                         const double *min_limit, const double *max_limit) {
+  size_t k = 0;
+  for (; k + 8 <= n; k += 8) {
+    __m512d c = _mm512_loadu_pd(cte + k);
+    __m512d p = _mm512_load_pd(p_error + k);
+    __m512d i = _mm512_add_pd(_mm512_load_pd(i_error + k), c);
+    i = Clamp512(i, _mm512_load_pd(min_limit + k), _mm512_load_pd(max_limit + k));
+    _mm512_store_pd(d_error + k, _mm512_sub_pd(c, p));
+    _mm512_store_pd(p_error + k, c);
+    _mm512_store_pd(i_error + k, i);
+  }
+  return k;
+}
+
+__attribute__((target("avx512f")))
+size_t TotalErrorAVX512(size_t n, double *out,
+                        const double *p_error, const double *i_error, const double *d_error,
+                        const double *Kp, const double *Ki, const double *Kd,
+                        const double *min_limit, const double *max_limit) {
+  size_t k = 0;
+  for (; k + 8 <= n; k += 8) {
+    __m512d t = _mm512_add_pd(_mm512_mul_pd(_mm512_load_pd(Kp + k), _mm512_load_pd(p_error + k)),
+                              _mm512_mul_pd(_mm512_load_pd(Ki + k), _mm512_load_pd(i_error + k)));
+    t = _mm512_add_pd(t, _mm512_mul_pd(_mm512_load_pd(Kd + k), _mm512_load_pd(d_error + k)));
+    t = Clamp512(t, _mm512_load_pd(min_limit + k), _mm512_load_pd(max_limit + k));
+    _mm512_storeu_pd(out + k, t);
+  }
+  return k;
+}
+
+#endif /* PID_BANK_X86 */
+
+}  // namespace
+
+PIDBank::PIDBank(size_t size) {
+  this->size = size;
+  this->backend = BestBackend();
+
+  size_t stride = (size + 7) / 8 * 8;
+  void *memory = nullptr;
+  if (posix_memalign(&memory, ALIGNMENT, NB_ARRAYS * (stride ? stride : 1) * sizeof(double)) != 0) {
+    throw std::bad_alloc();
+  }
+  this->block = static_cast<double*>(memory);
+
+  double *arrays[NB_ARRAYS];
+  for (size_t a = 0; a < NB_ARRAYS; a++) {
+    arrays[a] = block + a * stride;
+  }
+  this->p_error = arrays[0];
+  this->i_error = arrays[1];
+  this->d_error = arrays[2];
+  this->Kp = arrays[3];
+  this->Ki = arrays[4];
+  this->Kd = arrays[5];
+  this->min_output_limit = arrays[6];
+  this->max_output_limit = arrays[7];
+
+  for (size_t k = 0; k < size; k++) {
+    Init(k, 0, 0, 0);
+    min_output_limit[k] = -1.0;
+    max_output_limit[k] = 1.0;
+  }
+}
+
+PIDBank::~PIDBank() {
+  free(block);
+}
+
+void PIDBank::Init(size_t k, double Kp, double Ki, double Kd) {
+  this->Kp[k] = Kp;
+  this->Ki[k] = Ki;
+  this->Kd[k] = Kd;
+
+  this->p_error[k] = 0;
+  this->i_error[k] = 0;
+  this->d_error[k] = 0;
+}
+
+void PIDBank::UpdateError(const double *cte) {
+  size_t k = 0;
+#ifdef PID_BANK_X86
+  if (backend == BACKEND_AVX512) {
+    k = UpdateErrorAVX512(size, cte, p_error, i_error, d_error, min_output_limit, max_output_limit);
+  } else if (backend == BACKEND_AVX2) {
+    k = UpdateErrorAVX2(size, cte, p_error, i_error, d_error, min_output_limit, max_output_limit);
+  }
+#endif
+  // Remaining controllers (not a multiple of the vector width)
+  UpdateErrorScalar(k, size, cte, p_error, i_error, d_error, min_output_limit, max_output_limit);
+}
+
+void PIDBank::TotalError(double *out) const {
+  size_t k = 0;
+#ifdef PID_BANK_X86
+  if (backend == BACKEND_AVX512) {
+    k = TotalErrorAVX512(size, out, p_error, i_error, d_error, Kp, Ki, Kd,
+                         min_output_limit, max_output_limit);
+  } else if (backend == BACKEND_AVX2) {
+    k = TotalErrorAVX2(size, out, p_error, i_error, d_error, Kp, Ki, Kd,
+                       min_output_limit, max_output_limit);
+  }
+#endif
+  TotalErrorScalar(k, size, out, p_error, i_error, d_error, Kp, Ki, Kd,
+                   min_output_limit, max_output_limit);
+}
+
+BACKEND PIDBank::BestBackend() {
+#ifdef PID_BANK_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return BACKEND_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return BACKEND_AVX2;
+  }
+#endif
+  return BACKEND_SCALAR;
+}
+
+const char *PIDBank::BackendName(BACKEND backend) {
+  switch (backend) {
+    case BACKEND_AVX512:
+      return "avx512";
+    case BACKEND_AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef PID_BANK_H
+#define PID_BANK_H
+
+#include <cstddef>
+
+/*
+* Instruction set used by the batched updates
+*/
+enum BACKEND {
+  BACKEND_SCALAR,
+  BACKEND_AVX2,
+  BACKEND_AVX512
+};
+
+/*
+* N PID controllers stored as structure of arrays (one 64-byte aligned array
+* per coefficient / error), updated together. Same arithmetic as PID, in the
+* same order, so results are bit for bit those of N PID objects.
+*/
+class PIDBank {
+public:
+
+  ///* number of controllers
+  size_t size;
+
+  /*
+  * Errors
+  */
+  double *p_error;
+  double *i_error;
+  double *d_error;
+
+  /*
+  * Coefficients
+  */
+  double *Kp;
+  double *Ki;
+  double *Kd;
+
+  /*
+  * Output limits (steering values), -1.0 / 1.0 by default
+  */
+  double *min_output_limit;
+  double *max_output_limit;
+
+  ///* best instruction set supported by the CPU, can be lowered
+  BACKEND backend;
+
+  /*
+  * Constructor
+  */
+  PIDBank(size_t size);
+
+  /*
+  * Destructor.
+  */
+  virtual ~PIDBank();
+
+  /*
+  * Initialize controller k.
+  */
+  void Init(size_t k, double Kp, double Ki, double Kd);
+
+  /*
+  * Update the error variables of every controller, cte[k] for controller k.
+  */
+  void UpdateError(const double *cte);
+
+  /*
+  * Calculate the total error of every controller into out[k].
+  */
+  void TotalError(double *out) const;
+
+  static BACKEND BestBackend();
+
+  static const char *BackendName(BACKEND backend);
+
+private:
+  double *block;
+
+  PIDBank(const PIDBank &);
+  PIDBank &operator=(const PIDBank &);
+};
+
+#endif /* PID_BANK_H */
@@ -0,0 +1,62 @@
+#include "Parameters.h"
+
+namespace {
+
+struct parameter_info {
+  const char *name;
+  // initial change used by Twiddle
+  double dp;
+};
+
+const parameter_info infos[] = {
+  { "Kp", 1.0 },
+  { "Ki", 1.0 },
+  { "Kd", 1.0 },
+  { "throttle", 0.1 }
+};
+
+const parameter_info *FindInfo(const std::string &name) {
+  for (const parameter_info &info : infos) {
+    if (name == info.name) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+bool IsParameter(const std::string &name) {
+  return FindInfo(name) != nullptr;
+}
+
+double *FindParameter(const std::string &name, PID &pid, double &throttle,
+                      GainSchedule &schedule, int breakpoint) {
+  // Scheduled gains: the PID's are overwritten on every frame
+  const bool scheduled = schedule.Enabled() && breakpoint >= 0;
+  if (name == "Kp") {
+    return scheduled ? &schedule.Kp[breakpoint] : &pid.Kp;
+  }
+  if (name == "Ki") {
+    return scheduled ? &schedule.Ki[breakpoint] : &pid.Ki;
+  }
+  if (name == "Kd") {
+    return scheduled ? &schedule.Kd[breakpoint] : &pid.Kd;
+  }
+  if (name == "throttle") {
+    return &throttle;
+  }
+  return nullptr;
+}
+
+bool AddParameters(Twiddle &tw, const std::vector<std::string> &names, PID &pid, double &throttle,
+                   GainSchedule &schedule, int breakpoint) {
+  for (const std::string &name : names) {
+    double *param = FindParameter(name, pid, throttle, schedule, breakpoint);
+    if (param == nullptr) {
+      return false;
+    }
+    tw.AddParameter(name, param, FindInfo(name)->dp);
+  }
+  return true;
+}
@@ -0,0 +1,30 @@
+#ifndef PARAMETERS_H
+#define PARAMETERS_H
+
+#include <string>
+#include <vector>
+#include "GainSchedule.h"
+#include "PID.h"
+#include "Twiddle.h"
+
+/*
+* Is name a tunable parameter ("Kp", "Ki", "Kd" or "throttle")?
+*/
+bool IsParameter(const std::string &name);
+
+/*
+* Address of a tunable parameter, nullptr if the name is unknown. The gains
+* are those of breakpoint of the schedule when it is enabled, of pid
+* otherwise.
+*/
+double *FindParameter(const std::string &name, PID &pid, double &throttle,
+                      GainSchedule &schedule, int breakpoint);
+
+/*
+* Register the named parameters in Twiddle, with their initial change.
+* Returns false if a name is unknown.
+*/
+bool AddParameters(Twiddle &tw, const std::vector<std::string> &names, PID &pid, double &throttle,
+                   GainSchedule &schedule, int breakpoint);
+
+#endif /* PARAMETERS_H */
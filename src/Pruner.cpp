@@ -0,0 +1,97 @@
+#include "Pruner.h"
+
+#include <algorithm>
+#include <math.h>
+
+Pruner::Pruner() {
+  this->confidence = 0.0;
+  this->z = 0.0;
+  this->pruned = 0;
+  this->saved = 0;
+}
+
+Pruner::~Pruner() {}
+
+void Pruner::SetConfidence(double confidence) {
+  this->confidence = confidence;
+  // Solve P(N(0,1) > z) = 1 - confidence by bisection
+  double low = 0.0;
+  double high = 10.0;
+  for (int i = 0; i < 64; i++) {
+    double middle = 0.5 * (low + high);
+    if (0.5 * erfc(middle / sqrt(2.0)) > 1.0 - confidence) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  this->z = 0.5 * (low + high);
+}
+
+bool Pruner::Enabled() const {
+  return confidence > 0.0;
+}
+
+bool Pruner::IsCheckpoint(int dist) const {
+  return dist % PRUNE_INTERVAL == 0;
+}
+
+bool Pruner::Update(std::vector<double> &curve, int dist, double error, bool over, int max_dist) const {
+  if (!Enabled() || !(over || IsCheckpoint(dist))) {
+    return false;
+  }
+  curve.push_back(error);
+  return !over && Prune(curve, max_dist);
+}
+
+void Pruner::SetBest(const std::vector<double> &curve, int dist, int max_dist) {
+  // A shorter run doesn't tell the error over the whole distance
+  if (dist >= max_dist) {
+    best = curve;
+  } else {
+    best.clear();
+  }
+}
+
+void Pruner::Count(const std::vector<double> &curve, int max_dist) {
+  pruned++;
+  saved += max_dist - curve.size() * PRUNE_INTERVAL;
+}
+
+bool Pruner::Prune(const std::vector<double> &curve, int max_dist) const {
+  // Only checkpoints before the end of the best run are compared
+  const int k = curve.size();
+  if (!Enabled() || k < PRUNE_MIN_CHECKPOINTS || k >= (int) best.size()) {
+    return false;
+  }
+
+  // Difference with the best run on each segment
+  double sum = 0.0;
+  double sum_squares = 0.0;
+  for (int j = 0; j < k; j++) {
+    double segment = curve[j] - (j > 0 ? curve[j - 1] : 0.0);
+    double best_segment = best[j] - (j > 0 ? best[j - 1] : 0.0);
+    double difference = segment - best_segment;
+    sum += difference;
+    sum_squares += difference * difference;
+  }
+  double mean = sum / k;
+  double variance = std::max(0.0, (sum_squares - k * mean * mean) / (k - 1));
+
+  // Lower bound of the final excess: observed excess, plus the remaining
+  // segments' predicted sum minus z times its standard deviation (spread of
+  // the segments and uncertainty on their mean)
+  double remaining = (max_dist - k * PRUNE_INTERVAL) / (double) PRUNE_INTERVAL;
+  double excess = curve[k - 1] - best[k - 1];
+  double deviation = sqrt(variance * (remaining + remaining * remaining / k));
+  return excess + remaining * mean - z * deviation > 0.0;
+}
+
+double Pruner::Projected(const std::vector<double> &curve, int max_dist) const {
+  const int k = curve.size();
+  double remaining = (max_dist - k * PRUNE_INTERVAL) / (double) PRUNE_INTERVAL;
+  double excess = curve[k - 1] - best[k - 1];
+  // Mean segment difference (the sum of the differences is the excess)
+  double mean = excess / k;
+  return (best.back() + excess + remaining * mean) / max_dist;
+}
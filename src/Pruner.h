@@ -0,0 +1,85 @@
+#ifndef PRUNER_H
+#define PRUNER_H
+
+#include <vector>
+
+///* frames between two checkpoints of a run's error curve
+const int PRUNE_INTERVAL = 100;
+
+///* checkpoints compared before a run can be pruned
+const int PRUNE_MIN_CHECKPOINTS = 3;
+
+/*
+* Early termination of runs that can't beat the best one. A run's curve is
+* its total squared cte every PRUNE_INTERVAL frames (and at its end); it is
+* compared segment by segment with the best run's curve, and pruned when its
+* final total error exceeds the best one's with the given confidence: the
+* remaining segments are predicted from the mean and spread of the observed
+* differences. Disabled when confidence is 0.
+*/
+class Pruner {
+public:
+
+  ///* confidence required to prune a run (0: pruning disabled)
+  double confidence;
+
+  ///* one sided normal quantile of confidence
+  double z;
+
+  ///* curve of the best run, empty until it ran the whole distance
+  std::vector<double> best;
+
+  ///* runs pruned so far, and the frames they didn't run
+  long pruned;
+  long saved;
+
+  /*
+  * Constructor
+  */
+  Pruner();
+
+  /*
+  * Destructor.
+  */
+  virtual ~Pruner();
+
+  void SetConfidence(double confidence);
+
+  bool Enabled() const;
+
+  /*
+  * Is dist (frames run) a checkpoint of the curve?
+  */
+  bool IsCheckpoint(int dist) const;
+
+  /*
+  * Add the total error of a run at dist frames to its curve (at checkpoints,
+  * and at its end when over). Returns true when the run, not over yet, must
+  * be pruned.
+  */
+  bool Update(std::vector<double> &curve, int dist, double error, bool over, int max_dist) const;
+
+  /*
+  * Compare the next runs with this curve, if the run reached max_dist
+  */
+  void SetBest(const std::vector<double> &curve, int dist, int max_dist);
+
+  /*
+  * Count a pruned run and the frames it didn't run
+  */
+  void Count(const std::vector<double> &curve, int max_dist);
+
+  /*
+  * Can the run with this curve (up to its last checkpoint) not beat the
+  * best run of max_dist frames?
+  */
+  bool Prune(const std::vector<double> &curve, int max_dist) const;
+
+  /*
+  * Average squared cte the pruned run would have reached at max_dist:
+  * best total plus its excess so far and the predicted one
+  */
+  double Projected(const std::vector<double> &curve, int max_dist) const;
+};
+
+#endif /* PRUNER_H */
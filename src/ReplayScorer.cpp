@@ -0,0 +1,289 @@
+#include "ReplayScorer.h"
+
+#include <algorithm>
+#include <future>
+#include <math.h>
+#include "PIDBank.h"
+#include "Trace.h"
+
+namespace {
+
+// Segments replayed by one task: fixed, so that scores are summed in the
+// same order whatever the number of threads
+const size_t SEGMENTS_PER_TASK = 16;
+
+// Solve A x = y (n x n, row major) by Gaussian elimination with partial
+// pivoting. Returns false when A is singular.
+bool Solve(std::vector<double> A, std::vector<double> y, int n, std::vector<double> &x) {
+  for (int col = 0; col < n; col++) {
+    int pivot = col;
+    for (int row = col + 1; row < n; row++) {
+      if (fabs(A[row*n + col]) > fabs(A[pivot*n + col])) {
+        pivot = row;
+      }
+    }
+    if (fabs(A[pivot*n + col]) < 1E-12) {
+      return false;
+    }
+    for (int k = 0; k < n; k++) {
+      std::swap(A[col*n + k], A[pivot*n + k]);
+    }
+    std::swap(y[col], y[pivot]);
+    for (int row = col + 1; row < n; row++) {
+      double factor = A[row*n + col] / A[col*n + col];
+      for (int k = col; k < n; k++) {
+        A[row*n + k] -= factor * A[col*n + k];
+      }
+      y[row] -= factor * y[col];
+    }
+  }
+  x.assign(n, 0.0);
+  for (int row = n - 1; row >= 0; row--) {
+    double sum = y[row];
+    for (int k = row + 1; k < n; k++) {
+      sum -= A[row*n + k] * x[k];
+    }
+    x[row] = sum / A[row*n + row];
+  }
+  return true;
+}
+
+}  // namespace
+
+ReplayScorer::ReplayScorer(int max_dist) {
+  this->a = 0.0;
+  this->b = 0.0;
+  this->b_prev = 0.0;
+  this->bias = 0.0;
+  this->rms = 0.0;
+  this->max_dist = max_dist;
+}
+
+ReplayScorer::~ReplayScorer() {}
+
+bool ReplayScorer::Load(const std::string &path) {
+  TraceReader trace(path);
+  if (!trace.IsOpen()) {
+    return false;
+  }
+
+  replay_segment segment;
+  const trace_record *previous = nullptr;
+  for (const trace_record &record : trace) {
+    // Another run appended to the file, the simulator disconnected, or
+    // records were dropped (Twiddle counts the frames of a run)
+    if (previous != nullptr &&
+        (record.timestamp < previous->timestamp || record.timestamp - previous->timestamp > 1000000000 ||
+         (record.twiddle_used && previous->twiddle_used && previous->dist_count > 0 &&
+          record.dist_count != previous->dist_count + 1))) {
+      if (segment.cte.size() >= 3) {
+        segments.push_back(segment);
+      }
+      segment = replay_segment();
+    }
+    previous = &record;
+
+    segment.cte.push_back(record.cte);
+    segment.speed.push_back(record.speed);
+    segment.steer.push_back(record.steer_value);
+    if (segment.cte.size() == 2) {
+      segment.p_error = record.p_error;
+      segment.i_error = record.i_error;
+      segment.d_error = record.d_error;
+    }
+
+    // Last frame of a Twiddle run: the car is reset after it
+    if (record.twiddle_used && record.dist_count == 0) {
+      if (segment.cte.size() >= 3) {
+        segments.push_back(segment);
+      }
+      segment = replay_segment();
+    }
+  }
+  if (segment.cte.size() >= 3) {
+    segments.push_back(segment);
+  }
+  return true;
+}
+
+bool ReplayScorer::Fit() {
+  // Normal equations of the least squares fit, the last unknown is the bias
+  const int n = 4;
+  std::vector<double> A(n*n, 0.0);
+  std::vector<double> y(n, 0.0);
+  for (const replay_segment &segment : segments) {
+    const int length = std::min<int>(segment.cte.size(), max_dist);
+    for (int t = 1; t + 1 < length; t++) {
+      double x[n] = {
+        segment.cte[t] - segment.cte[t - 1],
+        segment.speed[t] * segment.steer[t],
+        segment.speed[t - 1] * segment.steer[t - 1],
+        1.0
+      };
+      double target = segment.cte[t + 1] - segment.cte[t];
+      for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+          A[i*n + j] += x[i] * x[j];
+        }
+        y[i] += x[i] * target;
+      }
+    }
+  }
+  std::vector<double> coefficients;
+  if (!Solve(A, y, n, coefficients)) {
+    return false;
+  }
+  a = coefficients[0];
+  b = coefficients[1];
+  b_prev = coefficients[2];
+  bias = coefficients[3];
+
+  // Predictions, and the disturbance (what they don't explain, bias
+  // included) spread
+  double sum_squares = 0.0;
+  long count = 0;
+  for (replay_segment &segment : segments) {
+    const int length = std::min<int>(segment.cte.size(), max_dist);
+    segment.predicted.assign(segment.cte.size(), 0.0);
+    for (int t = 1; t + 1 < length; t++) {
+      segment.predicted[t] = a * (segment.cte[t] - segment.cte[t - 1]) +
+                             b * segment.speed[t] * segment.steer[t] +
+                             b_prev * segment.speed[t - 1] * segment.steer[t - 1];
+      double disturbance = (segment.cte[t + 1] - segment.cte[t]) - segment.predicted[t];
+      sum_squares += (disturbance - bias) * (disturbance - bias);
+      count++;
+    }
+  }
+  rms = count > 0 ? sqrt(sum_squares / count) : 0.0;
+  return true;
+}
+
+long ReplayScorer::Frames() const {
+  long frames = 0;
+  for (const replay_segment &segment : segments) {
+    frames += std::min<long>(segment.cte.size(), max_dist);
+  }
+  return frames;
+}
+
+std::vector<run_result> ReplayScorer::Score(const std::vector<pid_gains> &gains, ThreadPool *pool) const {
+  const size_t n = gains.size();
+  std::vector<double> error(n, 0.0);
+  std::vector<long> dist(n, 0);
+
+  if (pool == nullptr || pool->Size() < 2) {
+    for (size_t first = 0; first < segments.size(); first += SEGMENTS_PER_TASK) {
+      std::vector<double> task_error(n, 0.0);
+      std::vector<long> task_dist(n, 0);
+      size_t last = std::min(first + SEGMENTS_PER_TASK, segments.size());
+      for (size_t s = first; s < last; s++) {
+        Replay(segments[s], gains, task_error, task_dist);
+      }
+      for (size_t k = 0; k < n; k++) {
+        error[k] += task_error[k];
+        dist[k] += task_dist[k];
+      }
+    }
+  }
+  else {
+    typedef std::pair<std::vector<double>, std::vector<long> > task_result;
+    std::vector<std::future<task_result> > tasks;
+    for (size_t first = 0; first < segments.size(); first += SEGMENTS_PER_TASK) {
+      size_t last = std::min(first + SEGMENTS_PER_TASK, segments.size());
+      tasks.push_back(pool->Submit([this, &gains, n, first, last]() {
+        task_result result(std::vector<double>(n, 0.0), std::vector<long>(n, 0));
+        for (size_t s = first; s < last; s++) {
+          Replay(segments[s], gains, result.first, result.second);
+        }
+        return result;
+      }));
+    }
+    // Summed in the serial order
+    for (std::future<task_result> &task : tasks) {
+      task_result result = task.get();
+      for (size_t k = 0; k < n; k++) {
+        error[k] += result.first[k];
+        dist[k] += result.second[k];
+      }
+    }
+  }
+
+  const long frames = Frames();
+  std::vector<run_result> results(n);
+  for (size_t k = 0; k < n; k++) {
+    results[k].avg_error = dist[k] > 0 ? error[k] / dist[k] : INFINITY;
+    results[k].dist = frames > 0 ? (int) llround((double) max_dist * dist[k] / frames) : 0;
+    results[k].pruned = false;
+  }
+  return results;
+}
+
+void ReplayScorer::Replay(const replay_segment &segment, const std::vector<pid_gains> &gains,
+                          std::vector<double> &error, std::vector<long> &dist) const {
+  const size_t n = gains.size();
+  const int length = std::min<int>(segment.cte.size(), max_dist);
+
+  // Every candidate starts from the recorded frames 0 and 1, with the PID
+  // errors of frame 1
+  PIDBank bank(n);
+  std::vector<double> cte_prev(n, segment.cte[0]);
+  std::vector<double> cte(n, segment.cte[1]);
+  std::vector<double> steer_prev(n, segment.steer[0]);
+  std::vector<double> steer(n);
+  std::vector<double> on_road(n, 1.0);
+  std::vector<double> total(n, segment.cte[0]*segment.cte[0] + segment.cte[1]*segment.cte[1]);
+  std::vector<double> driven(n, 2.0);
+  for (size_t k = 0; k < n; k++) {
+    bank.Init(k, gains[k].Kp, gains[k].Ki, gains[k].Kd);
+    bank.min_output_limit[k] = gains[k].min_output_limit;
+    bank.max_output_limit[k] = gains[k].max_output_limit;
+    bank.p_error[k] = segment.p_error;
+    bank.i_error[k] = segment.i_error;
+    bank.d_error[k] = segment.d_error;
+  }
+  bank.TotalError(steer.data());
+  for (size_t k = 0; k < n; k++) {
+    steer[k] = -steer[k];
+  }
+
+  for (int t = 1; t + 1 < length; t++) {
+    const double speed = segment.speed[t];
+    const double speed_prev = segment.speed[t - 1];
+    const double recorded = segment.cte[t];
+    const double recorded_next = segment.cte[t + 1];
+    const double predicted = segment.predicted[t];
+    // Frame t + 1 is the (t + 2)th of the drive: same early stop as
+    // Twiddle::IsRunOver after 50 frames
+    const bool check = t + 2 > 50;
+    for (size_t k = 0; k < n; k++) {
+      // Same expression as the recorded prediction: exactly recorded_next
+      // when the candidate drove as recorded
+      double change = a * (cte[k] - cte_prev[k]) + b * speed * steer[k] + b_prev * speed_prev * steer_prev[k];
+      double next = recorded_next + (cte[k] - recorded) + (change - predicted);
+      total[k] += on_road[k] * next * next;
+      driven[k] += on_road[k];
+      // Off the road: the frame counts, the next ones don't (and the lane
+      // is parked at cte 0 so that it doesn't diverge)
+      on_road[k] = (check && fabs(next) >= 4.0) ? 0.0 : on_road[k];
+      cte_prev[k] = cte[k];
+      cte[k] = next * on_road[k];
+      steer_prev[k] = steer[k];
+    }
+
+    bank.UpdateError(cte.data());
+    bank.TotalError(steer.data());
+    for (size_t k = 0; k < n; k++) {
+      steer[k] = -steer[k];
+    }
+
+    // Recorded car stopped: the drive is over for everyone
+    if (check && segment.speed[t + 1] <= 1.0) {
+      break;
+    }
+  }
+
+  for (size_t k = 0; k < n; k++) {
+    error[k] += total[k];
+    dist[k] += (long) driven[k];
+  }
+}
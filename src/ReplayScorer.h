@@ -0,0 +1,105 @@
+#ifndef REPLAY_SCORER_H
+#define REPLAY_SCORER_H
+
+#include <string>
+#include <vector>
+#include "GainStore.h"
+#include "RunCache.h"
+#include "ThreadPool.h"
+
+/*
+* Frames of one uninterrupted drive of a trace (between two Twiddle resets)
+*/
+struct replay_segment {
+  std::vector<double> cte;
+  std::vector<double> speed;
+  std::vector<double> steer;
+
+  ///* change of cte predicted by the lateral model from the recorded frames
+  ///* (cte[t+1] - cte[t] minus the disturbance, see ReplayScorer)
+  std::vector<double> predicted;
+
+  ///* PID errors after the update of frame 1, where the replay starts
+  double p_error;
+  double i_error;
+  double d_error;
+};
+
+/*
+* Open-loop scoring of PID gains on recorded traces, without a simulator.
+* A linear lateral model is fitted to the traces:
+*
+*   cte[t+1] - cte[t] = a (cte[t] - cte[t-1]) + b speed[t] steer[t]
+*                       + b_prev speed[t-1] steer[t-1] + disturbance[t]
+*
+* and the drives are replayed with other gains, with the recorded speeds and
+* disturbances (road curvature...). A replayed frame is the recorded one plus
+* the change the model predicts from the difference in steering, and the
+* controllers are a PIDBank, with the arithmetic of PID: the recorded gains
+* replay the recorded drive bit for bit.
+*/
+class ReplayScorer {
+public:
+
+  ///* lateral model, see above
+  double a;
+  double b;
+  double b_prev;
+
+  ///* mean of the disturbance, and root mean square about it
+  double bias;
+  double rms;
+
+  ///* drives longer than this are only replayed up to it
+  int max_dist;
+
+  std::vector<replay_segment> segments;
+
+  /*
+  * Constructor
+  */
+  ReplayScorer(int max_dist);
+
+  /*
+  * Destructor.
+  */
+  virtual ~ReplayScorer();
+
+  /*
+  * Add the drives of a trace file: split at Twiddle resets, at dropped
+  * records, and where the clock goes back or stops for more than 1s
+  * (another run appended).
+  */
+  bool Load(const std::string &path);
+
+  /*
+  * Least squares fit of the model on every segment, then its predictions.
+  * Returns false when the traces don't determine the model (e.g. the steering
+  * never changes).
+  */
+  bool Fit();
+
+  /*
+  * Number of frames replayed per candidate
+  */
+  long Frames() const;
+
+  /*
+  * Score each candidate on every segment: average squared cte, and distance
+  * driven on the track scaled to max_dist (max_dist when the car never
+  * leaves the road). Candidates are replayed together, segments in parallel
+  * on the pool if any.
+  */
+  std::vector<run_result> Score(const std::vector<pid_gains> &gains, ThreadPool *pool) const;
+
+private:
+
+  /*
+  * Replay segment with every candidate: adds their total squared cte and
+  * the frames they drove on the road to error / dist
+  */
+  void Replay(const replay_segment &segment, const std::vector<pid_gains> &gains,
+              std::vector<double> &error, std::vector<long> &dist) const;
+};
+
+#endif /* REPLAY_SCORER_H */
@@ -0,0 +1,53 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+* Lock-free single-producer / single-consumer ring of N (power of 2) items
+*/
+template <typename T, size_t N>
+class RingBuffer {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer size must be a power of 2");
+
+public:
+  RingBuffer() : head(0), tail(0) {}
+
+  /*
+  * Producer side. Returns false (and drops the item) when the ring is full.
+  */
+  bool Push(const T &item) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    items[h & (N - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /*
+  * Consumer side. Returns false when the ring is empty.
+  */
+  bool Pop(T &item) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  // head and tail on their own cache lines: written by different threads.
+  // Padding rather than alignas, so rings can be allocated with new.
+  std::atomic<size_t> head;
+  char head_padding[64];
+  std::atomic<size_t> tail;
+  char tail_padding[64];
+  T items[N];
+};
+
+#endif /* RING_BUFFER_H */
@@ -0,0 +1,47 @@
+#include "RunCache.h"
+
+#include <math.h>
+
+RunCache::RunCache() {
+  this->tolerance = 0.0;
+  this->hits = 0;
+  this->misses = 0;
+}
+
+RunCache::~RunCache() {}
+
+bool RunCache::Enabled() const {
+  return tolerance > 0.0;
+}
+
+bool RunCache::Find(const std::vector<double> &values, run_result &result) {
+  if (!Enabled()) {
+    return false;
+  }
+  auto found = results.find(Key(values));
+  if (found == results.end()) {
+    misses++;
+    return false;
+  }
+  hits++;
+  result = found->second;
+  return true;
+}
+
+bool RunCache::Contains(const std::vector<double> &values) const {
+  return Enabled() && results.count(Key(values)) > 0;
+}
+
+void RunCache::Insert(const std::vector<double> &values, const run_result &result) {
+  if (Enabled()) {
+    results[Key(values)] = result;
+  }
+}
+
+std::vector<long long> RunCache::Key(const std::vector<double> &values) const {
+  std::vector<long long> key;
+  for (double value : values) {
+    key.push_back(llround(value / tolerance));
+  }
+  return key;
+}
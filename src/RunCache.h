@@ -0,0 +1,60 @@
+#ifndef RUN_CACHE_H
+#define RUN_CACHE_H
+
+#include <map>
+#include <vector>
+
+/*
+* Score of a run: average squared cte and distance reached. Pruned runs are
+* scored with their projected error over the whole distance (see Pruner).
+*/
+struct run_result {
+  double avg_error;
+  int dist;
+  std::vector<double> curve;
+  bool pruned;
+};
+
+/*
+* Scores of the parameter vectors already run, keyed on the values rounded
+* to a multiple of tolerance. Disabled when tolerance is 0.
+*/
+class RunCache {
+public:
+
+  ///* values closer than this share a cache entry (0: cache disabled)
+  double tolerance;
+
+  ///* lookups that found / didn't find a score
+  long hits;
+  long misses;
+
+  ///* scores, by values rounded to a multiple of tolerance (see Key)
+  std::map<std::vector<long long>, run_result> results;
+
+  /*
+  * Constructor
+  */
+  RunCache();
+
+  /*
+  * Destructor.
+  */
+  virtual ~RunCache();
+
+  bool Enabled() const;
+
+  /*
+  * Look for the score of values, counting hits and misses
+  */
+  bool Find(const std::vector<double> &values, run_result &result);
+
+  bool Contains(const std::vector<double> &values) const;
+
+  void Insert(const std::vector<double> &values, const run_result &result);
+
+private:
+  std::vector<long long> Key(const std::vector<double> &values) const;
+};
+
+#endif /* RUN_CACHE_H */
@@ -0,0 +1,324 @@
+#include "Session.h"
+
+#include <iostream>
+#include "Optimizer.h"
+#include "Parameters.h"
+
+Session::Session(Logger &log, Metrics &metrics, const Options &options)
+  : schedule(options.gain_schedule), tw(options.max_dist), log(log), metrics(metrics),
+    checkpoint(options.checkpoint) {
+  this->id = 0;
+  this->frames = 0;
+  this->pending_received = 0;
+  this->pending_frames = 0;
+  this->pending_cte_sum = 0.0;
+  this->pid.Init(options.Kp, options.Ki, options.Kd);
+  this->schedule_file = options.breakpoint >= 0 ? options.schedule : "";
+  this->breakpoint = options.breakpoint;
+  this->throttle = 0.3;
+  this->msg.length = 0;
+  this->trace = nullptr;
+  this->gains = nullptr;
+  this->farm = nullptr;
+  this->ticket = -1;
+  this->farm_version = 0;
+  this->dist = 0;
+  this->error = 0.0;
+  this->parked = false;
+  this->curve.reserve(this->tw.curve.capacity());
+  // Odd: never a published version, the first poll copies the gains
+  this->gains_version = UINT64_MAX;
+
+  // Parameters optimized by twiddle (names are checked by ParseOptions)
+  AddParameters(this->tw, options.tune, this->pid, this->throttle, this->schedule, options.breakpoint);
+  this->tw.cache.tolerance = options.cache;
+  this->tw.pruner.SetConfidence(options.prune);
+
+  // Other search than Twiddle's, with its initial dp as steps (it sets the
+  // parameters to its first candidate: only when tuning)
+  if (this->tw.is_used) {
+    std::vector<double> steps;
+    for (const dp_state &state : this->tw.dp) {
+      steps.push_back(state.value);
+    }
+    Optimizer *optimizer = MakeOptimizer(options.optimizer, this->tw.Values(), steps, options.budget);
+    if (optimizer != nullptr) {
+      this->tw.SetOptimizer(optimizer);
+    }
+  }
+
+  // Gains at a standstill until the first frame
+  Schedule(0.0);
+}
+
+Session::~Session() {}
+
+message_replies Session::OnMessage(const char *data, size_t length, uint64_t received, uint64_t &t, bool coalesce) {
+  message_replies replies = { false, false, false, false };
+
+  // "42" at the start of the message means there's a websocket message event.
+  // The 4 signifies a websocket message
+  // The 2 signifies a websocket event
+  if (!(length > 2 && data[0] == '4' && data[1] == '2')) {
+    return replies;
+  }
+
+  // Fast path for telemetry, generic json parsing for anything else
+  Telemetry telemetry;
+  EVENT event = ParseTelemetry(data, length, telemetry);
+  if (event == EVENT_OTHER) {
+    event = ParseEvent(data, length, telemetry);
+  }
+  metrics.Lap(STAGE_PARSE, t);
+
+  if (event == EVENT_MANUAL) {
+    // Manual driving
+    replies.manual = true;
+    return replies;
+  }
+  if (event != EVENT_TELEMETRY) {
+    return replies;
+  }
+
+  // Use parameters optimization (twiddle), or run the farm's candidates
+  // (--farm)
+  bool tuning = tw.is_used;
+  if (farm != nullptr) {
+    replies.reset = FarmStep(telemetry.cte, telemetry.speed);
+  }
+  else if (tw.is_used && tw.Step(telemetry.cte, telemetry.speed, log)) {
+    Checkpoint();
+    replies.reset = true;
+  }
+  // Twiddle done: its breakpoint goes to the schedule file
+  if (tuning && !tw.is_used) {
+    SaveSchedule();
+  }
+
+  metrics.Lap(STAGE_TWIDDLE, t);
+  frames++;
+
+  if (coalesce) {
+    // Replied to by SteerPending, unless a newer frame comes first
+    replies.queue = pending_frames == 0;
+    pending_cte_sum = (pending_frames == 0 ? 0.0 : pending_cte_sum) + telemetry.cte;
+    pending = telemetry;
+    pending_received = received;
+    pending_frames++;
+  } else {
+    Steer(telemetry, received, t);
+    replies.steer = true;
+  }
+  return replies;
+}
+
+void Session::Steer(const Telemetry &telemetry, uint64_t received, uint64_t &t) {
+  Steer(telemetry, received, t, 1, telemetry.cte);
+}
+
+void Session::SteerPending(uint64_t &t) {
+  int skipped = pending_frames - 1;
+  metrics.coalesced.store(metrics.coalesced.load(std::memory_order_relaxed) + skipped,
+                          std::memory_order_relaxed);
+  Steer(pending, pending_received, t, pending_frames, pending_cte_sum);
+  pending_frames = 0;
+}
+
+void Session::Steer(const Telemetry &telemetry, uint64_t received, uint64_t &t, int frames, double cte_sum) {
+  double cte = telemetry.cte;
+
+  // Predict steering angle from errors, with the latest published gains
+  // (or the scheduled ones at this speed)
+  UpdateGains();
+  Schedule(telemetry.speed);
+  pid.UpdateError(cte, frames, cte_sum);
+  double steer_value = -pid.TotalError();
+  metrics.Lap(STAGE_PID, t);
+
+  // Parked (--farm, no candidate to run): stay on the start line
+  double throttle = this->throttle;
+  if (parked) {
+    steer_value = 0.0;
+    throttle = 0.0;
+  }
+
+  EncodeSteer(steer_value, throttle, msg);
+  metrics.Lap(STAGE_ENCODE, t);
+
+  // Log info: only in running mode
+  if (!tw.is_used && farm == nullptr) {
+    log.Control(cte, steer_value, throttle);
+  }
+
+  Record(received, telemetry, steer_value);
+}
+
+void Session::UpdateGains() {
+  pid_gains published;
+  if (gains != nullptr && gains->Poll(gains_version, published)) {
+    SetGains(pid, published);
+  }
+}
+
+void Session::Schedule(double speed) {
+  if (schedule.Enabled()) {
+    schedule.Apply(pid, speed);
+  }
+}
+
+bool Session::FarmStep(double cte, double speed) {
+  // The candidates changed: drop the current one if not needed anymore,
+  // or get one if parked
+  uint64_t version = farm->Version();
+  if (version != farm_version) {
+    farm_version = version;
+    if (ticket < 0 || farm->IsStale(ticket)) {
+      NextCandidate();
+      return !parked;
+    }
+  }
+  if (ticket < 0) {
+    return false;
+  }
+
+  // Same scoring as Twiddle::Step
+  dist += 1;
+  error += cte*cte;
+  bool over = tw.IsRunOver(dist, cte, speed);
+  run_result result;
+  if (pruner.Update(curve, dist, error, over, tw.max_dist)) {
+    result.avg_error = pruner.Projected(curve, tw.max_dist);
+    result.dist = tw.max_dist;
+    result.pruned = true;
+  }
+  else if (over) {
+    result.avg_error = error / dist;
+    result.dist = dist;
+    result.pruned = false;
+  }
+  else {
+    return false;
+  }
+  result.curve = curve;
+  farm->Finish(ticket, result);
+  ticket = -1;
+  NextCandidate();
+  return true;
+}
+
+void Session::NextCandidate() {
+  ticket = -1;
+  dist = 0;
+  error = 0.0;
+  curve.clear();
+
+  std::vector<double> candidate;
+  parked = !farm->Acquire(candidate, ticket, pruner);
+  if (parked && farm->IsDone()) {
+    // Tuning over: keep driving with the result
+    candidate = farm->Values();
+    parked = false;
+    farm = nullptr;
+  }
+  if (!parked) {
+    tw.SetValues(candidate);
+    pid.Init();
+  }
+}
+
+void Session::JoinFarm(Coordinator *farm) {
+  this->farm = farm;
+  tw.is_used = false;
+  farm->Attach();
+}
+
+void Session::LeaveFarm() {
+  if (farm != nullptr) {
+    if (ticket >= 0) {
+      farm->Release(ticket);
+    }
+    farm->Detach();
+    farm = nullptr;
+  }
+}
+
+void Session::Record(uint64_t received, const Telemetry &telemetry, double steer_value) {
+  if (trace == nullptr) {
+    return;
+  }
+
+  trace_record record;
+  record.timestamp = received;
+  record.cte = telemetry.cte;
+  record.speed = telemetry.speed;
+  record.steering_angle = telemetry.steering_angle;
+  record.steer_value = steer_value;
+  record.throttle = throttle;
+  record.p_error = pid.p_error;
+  record.i_error = pid.i_error;
+  record.d_error = pid.d_error;
+  record.Kp = pid.Kp;
+  record.Ki = pid.Ki;
+  record.Kd = pid.Kd;
+  record.avg_error = tw.avg_error;
+  record.best_error = tw.best_error;
+  // Farm runs are recorded as Twiddle runs (split the same way on replay)
+  record.twiddle_used = tw.is_used || farm != nullptr;
+  record.twiddle_it = tw.it;
+  record.param_index = tw.param_index;
+  record.dist_count = farm != nullptr ? dist : tw.dist_count;
+  trace->Write(record);
+}
+
+void Session::Checkpoint() {
+  if (checkpoint.empty()) {
+    return;
+  }
+  if (checkpoint_writer) {
+    checkpoint_writer->Save(tw, pid, schedule_file, breakpoint);
+  }
+  else if (!SaveCheckpoint(checkpoint, tw, pid, schedule_file, breakpoint)) {
+    std::cerr << "Failed to write checkpoint " << checkpoint << std::endl;
+  }
+}
+
+void Session::CheckpointInBackground() {
+  if (!checkpoint.empty()) {
+    checkpoint_writer.reset(new CheckpointWriter(checkpoint));
+  }
+}
+
+void Session::SaveSchedule() {
+  if (!schedule_file.empty() && !schedule.Save(schedule_file)) {
+    std::cerr << "Failed to write gain schedule " << schedule_file << std::endl;
+  }
+}
+
+std::string SessionPath(const std::string &path, int id) {
+  if (path.empty() || id == 0) {
+    return path;
+  }
+  return path + "." + std::to_string(id);
+}
+
+SessionIds::SessionIds() {}
+
+SessionIds::~SessionIds() {}
+
+int SessionIds::Acquire() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t id = 0;
+  while (id < used.size() && used[id]) {
+    id++;
+  }
+  if (id == used.size()) {
+    used.push_back(false);
+  }
+  used[id] = true;
+  return id;
+}
+
+void SessionIds::Release(int id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  used[id] = false;
+}
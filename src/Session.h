@@ -0,0 +1,245 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Checkpoint.h"
+#include "Codec.h"
+#include "Coordinator.h"
+#include "GainSchedule.h"
+#include "GainStore.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Options.h"
+#include "PID.h"
+#include "Trace.h"
+#include "Twiddle.h"
+
+/*
+* Replies to a message of the simulator, to send in this order
+*/
+struct message_replies {
+  ///* reset the simulator (run over)
+  bool reset;
+
+  ///* manual driving
+  bool manual;
+
+  ///* steering values, in the session's msg
+  bool steer;
+
+  ///* coalesced frame, the first one pending: reply with SteerPending once
+  ///* the frames received together are handled
+  bool queue;
+};
+
+/*
+* Controller state of one simulator connection
+*/
+class Session {
+public:
+  ///* 0 for the first connected simulator (lowest free id)
+  int id;
+
+  ///* telemetry frames handled
+  uint64_t frames;
+
+  ///* newest frame not replied to yet (--coalesce), its receive time, the
+  ///* number of frames it stands for (0: none pending) and the sum of
+  ///* their cte
+  Telemetry pending;
+  uint64_t pending_received;
+  int pending_frames;
+  double pending_cte_sum;
+
+  ///* steering controller
+  PID pid;
+
+  ///* gains of pid by speed, set on every frame (--schedule), and the file
+  ///* it is written to once Twiddle has tuned one of its breakpoints (empty
+  ///* if none)
+  GainSchedule schedule;
+  std::string schedule_file;
+
+  ///* breakpoint of schedule Twiddle tunes (-1: none, the gains of pid)
+  int breakpoint;
+
+  ///* parameters optimizer
+  Twiddle tw;
+
+  ///* farm the simulator runs candidates for (--farm) instead of tw,
+  ///* nullptr if none or once the farm is done
+  Coordinator *farm;
+
+  ///* farm candidate being run (-1: none, the car is parked), the farm
+  ///* version it was last checked against, and the pruner to run it with
+  long ticket;
+  uint64_t farm_version;
+  Pruner pruner;
+
+  ///* farm run: frames, total squared cte, and its curve (see Pruner)
+  int dist;
+  double error;
+  std::vector<double> curve;
+
+  ///* no candidate to run: stopped, waiting for the other simulators
+  bool parked;
+
+  ///* constant throttle sent with every steering value
+  double throttle;
+
+  ///* reply buffer, reused for every frame
+  Message msg;
+
+  ///* console output, written by a background thread
+  Logger &log;
+
+  ///* telemetry handler latency histograms
+  Metrics &metrics;
+
+  ///* telemetry recorder, nullptr if not recording
+  TraceWriter *trace;
+
+  ///* gains published by other threads, nullptr if fixed (e.g. tuning)
+  GainStore *gains;
+
+  ///* version of the gains last copied to pid
+  uint64_t gains_version;
+
+  ///* file the Twiddle state is saved to after every run, if not empty
+  std::string checkpoint;
+
+  ///* writes the checkpoints from a background thread, nullptr to write
+  ///* them in Checkpoint()
+  std::unique_ptr<CheckpointWriter> checkpoint_writer;
+
+  /*
+  * Constructor
+  */
+  Session(Logger &log, Metrics &metrics, const Options &options);
+
+  /*
+  * Destructor.
+  */
+  virtual ~Session();
+
+  /*
+  * Handle a message of the simulator: parse it, feed a telemetry frame to
+  * Twiddle (or the farm run), and steer (unless coalesced). The stages are
+  * timed from t, up to the steer encoding.
+  */
+  message_replies OnMessage(const char *data, size_t length, uint64_t received, uint64_t &t, bool coalesce);
+
+  /*
+  * Steering on the telemetry of a frame, with the latest published gains
+  * (or the scheduled ones at its speed): encoded in msg, and traced
+  */
+  void Steer(const Telemetry &telemetry, uint64_t received, uint64_t &t);
+
+  /*
+  * Steer on the newest pending frame (--coalesce), the previous ones
+  * skipped
+  */
+  void SteerPending(uint64_t &t);
+
+  /*
+  * Copy the gains published since the last frame (if any) to pid
+  */
+  void UpdateGains();
+
+  /*
+  * Gains of the schedule at speed (if any) to pid: once per frame, before
+  * the PID update
+  */
+  void Schedule(double speed);
+
+  /*
+  * Feed one telemetry frame to the farm run. Returns true when the
+  * simulator must be reset: the run is over (its result is sent to the
+  * farm) or stale, and the next candidate is set.
+  */
+  bool FarmStep(double cte, double speed);
+
+  /*
+  * Start the next farm candidate, or park the car if there is none. Once
+  * the farm is done, drive with its parameters.
+  */
+  void NextCandidate();
+
+  /*
+  * Run candidates for farm instead of tw from the next frame
+  */
+  void JoinFarm(Coordinator *farm);
+
+  /*
+  * Leave the farm (e.g. disconnected), handing back the current candidate
+  */
+  void LeaveFarm();
+
+  /*
+  * Save the Twiddle state to the checkpoint file (if any)
+  */
+  void Checkpoint();
+
+  /*
+  * From now on, Checkpoint() only captures the state and a background
+  * thread writes it (e.g. checkpoints taken under the farm's lock)
+  */
+  void CheckpointInBackground();
+
+  /*
+  * Save the gain schedule, its breakpoint tuned, to the schedule file (if
+  * any)
+  */
+  void SaveSchedule();
+
+  /*
+  * Append a frame to the trace (if any)
+  */
+  void Record(uint64_t received, const Telemetry &telemetry, double steer_value);
+
+private:
+
+  /*
+  * Steer, frames: telemetry frames since the previous update (more than 1
+  * when the older ones were coalesced), cte_sum: the sum of their cte
+  */
+  void Steer(const Telemetry &telemetry, uint64_t received, uint64_t &t, int frames, double cte_sum);
+};
+
+/*
+* Ids of the open sessions, shared by the serving threads (only used when
+* simulators connect and disconnect)
+*/
+class SessionIds {
+public:
+
+  /*
+  * Constructor
+  */
+  SessionIds();
+
+  /*
+  * Destructor.
+  */
+  virtual ~SessionIds();
+
+  /*
+  * Lowest free id, now in use
+  */
+  int Acquire();
+
+  void Release(int id);
+
+private:
+  std::mutex mutex;
+  std::vector<bool> used;
+};
+
+/*
+* File of session id: path itself for session 0, path.id for the others
+*/
+std::string SessionPath(const std::string &path, int id);
+
+#endif /* SESSION_H */
@@ -0,0 +1,80 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int nb_threads) : pending(0), next(0), stop(false) {
+  if (nb_threads < 1) {
+    nb_threads = 1;
+  }
+  for (int i = 0; i < nb_threads; i++) {
+    queues.push_back(std::unique_ptr<worker_queue>(new worker_queue));
+  }
+  for (int i = 0; i < nb_threads; i++) {
+    threads.push_back(std::thread(&ThreadPool::Run, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  wakeup.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+int ThreadPool::Size() const {
+  return threads.size();
+}
+
+void ThreadPool::Push(std::function<void()> task) {
+  // Spread the tasks over the queues, idle workers steal the rest
+  worker_queue &queue = *queues[next++ % queues.size()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending++;
+  }
+  wakeup.notify_one();
+}
+
+bool ThreadPool::Pop(int index, std::function<void()> &task) {
+  const int n = queues.size();
+  for (int k = 0; k < n; k++) {
+    worker_queue &queue = *queues[(index + k) % n];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    // Own queue: newest task first (LIFO); others: steal the oldest one
+    if (k == 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    pending--;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::Run(int index) {
+  std::function<void()> task;
+  for (;;) {
+    if (Pop(index, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    wakeup.wait(lock, [this]() { return stop || pending > 0; });
+    if (stop && pending == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* Work-stealing thread pool: every worker has its own queue, and takes
+* tasks from the other queues when its own is empty.
+*/
+class ThreadPool {
+public:
+
+  /*
+  * Constructor: starts nb_threads workers
+  */
+  ThreadPool(int nb_threads);
+
+  /*
+  * Destructor: runs the remaining tasks and stops the workers.
+  */
+  virtual ~ThreadPool();
+
+  int Size() const;
+
+  /*
+  * Queue f(), the result is available through the returned future
+  */
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> Submit(F f) {
+    typedef typename std::result_of<F()>::type R;
+    std::shared_ptr<std::packaged_task<R()>> task(new std::packaged_task<R()>(f));
+    std::future<R> result = task->get_future();
+    Push([task]() { (*task)(); });
+    return result;
+  }
+
+private:
+  struct worker_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<worker_queue>> queues;
+  std::vector<std::thread> threads;
+
+  // Sleeping workers wait on this when no queue has work
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::atomic<int> pending;
+  std::atomic<unsigned> next;
+  bool stop;
+
+  void Push(std::function<void()> task);
+
+  bool Pop(int index, std::function<void()> &task);
+
+  void Run(int index);
+};
+
+#endif /* THREAD_POOL_H */
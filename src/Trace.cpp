@@ -0,0 +1,173 @@
+#include "Trace.h"
+
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+trace_header Header() {
+  trace_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(trace_record);
+  return header;
+}
+
+// Write all of data at the end of the file, false if any of it wasn't
+bool WriteAll(int fd, const void *data, size_t size) {
+  ssize_t written = write(fd, data, size);
+  return written == static_cast<ssize_t>(size);
+}
+
+}  // namespace
+
+TraceWriter::TraceWriter(const std::string &path) : dropped(0), length(0), running(true) {
+  this->fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (this->fd < 0) {
+    return;
+  }
+
+  struct stat st;
+  bool ok = fstat(this->fd, &st) == 0;
+  const trace_header expected = Header();
+  uint64_t size = ok ? st.st_size : 0;
+  if (ok && size >= sizeof(trace_header)) {
+    // Existing trace: only append records of the same layout
+    trace_header header;
+    ok = pread(this->fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    if (ok && (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+               header.version != TRACE_VERSION || header.record_size != sizeof(trace_record))) {
+      std::cerr << "Trace file " << path << " is not a version " << TRACE_VERSION << " trace" << std::endl;
+      ok = false;
+    }
+    // Partly written last record (crash): cut it off, or all the records
+    // appended after it would be misaligned
+    uint64_t whole = sizeof(trace_header) + (size - sizeof(trace_header)) / sizeof(trace_record) * sizeof(trace_record);
+    if (ok && whole != size) {
+      ok = ftruncate(this->fd, whole) == 0;
+    }
+    this->length = whole;
+  }
+  else if (ok) {
+    // New file, or only part of a header written: (re)write the header
+    char existing[sizeof(trace_header)];
+    ok = pread(this->fd, existing, size, 0) == static_cast<ssize_t>(size);
+    if (ok && memcmp(existing, &expected, size) != 0) {
+      std::cerr << "Trace file " << path << " is not a trace" << std::endl;
+      ok = false;
+    }
+    ok = ok && ftruncate(this->fd, 0) == 0 && WriteAll(this->fd, &expected, sizeof(expected));
+    this->length = sizeof(trace_header);
+  }
+  if (!ok) {
+    close(this->fd);
+    this->fd = -1;
+    return;
+  }
+
+  this->thread = std::thread(&TraceWriter::Run, this);
+}
+
+TraceWriter::~TraceWriter() {
+  if (fd < 0) {
+    return;
+  }
+  running.store(false, std::memory_order_release);
+  thread.join();
+  close(fd);
+}
+
+bool TraceWriter::IsOpen() const {
+  return fd >= 0;
+}
+
+void TraceWriter::Run() {
+  const size_t batch_size = 256;
+  trace_record batch[batch_size];
+  for (;;) {
+    bool stop = !running.load(std::memory_order_acquire);
+
+    for (;;) {
+      size_t n = 0;
+      while (n < batch_size && ring.Pop(batch[n])) {
+        n++;
+      }
+      if (n == 0) {
+        break;
+      }
+      Append(batch, n);
+    }
+
+    if (stop) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void TraceWriter::Append(const trace_record *records, size_t n) {
+  ssize_t written = write(fd, records, n * sizeof(trace_record));
+  size_t whole = written > 0 ? written / sizeof(trace_record) : 0;
+  if (written != static_cast<ssize_t>(n * sizeof(trace_record))) {
+    // Keep the file a header and whole records (the next writes may work)
+    if (written > 0) {
+      (void) ftruncate(fd, length + whole * sizeof(trace_record));
+    }
+    dropped.fetch_add(n - whole, std::memory_order_relaxed);
+  }
+  length += whole * sizeof(trace_record);
+}
+
+TraceReader::TraceReader(const std::string &path) : data(nullptr), length(0), records(nullptr), size(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(trace_header)) {
+    close(fd);
+    return;
+  }
+
+  void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return;
+  }
+
+  const trace_header *header = static_cast<const trace_header *>(p);
+  if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != TRACE_VERSION || header->record_size != sizeof(trace_record)) {
+    munmap(p, st.st_size);
+    return;
+  }
+
+  // Records are read in order, once: let the kernel read ahead
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+  this->data = p;
+  this->length = st.st_size;
+  this->records = reinterpret_cast<const trace_record *>(static_cast<const char *>(p) + sizeof(trace_header));
+  // A partly written last record is ignored
+  this->size = (st.st_size - sizeof(trace_header)) / sizeof(trace_record);
+}
+
+TraceReader::~TraceReader() {
+  if (data != nullptr) {
+    munmap(data, length);
+  }
+}
+
+bool TraceReader::IsOpen() const {
+  return data != nullptr;
+}
+
+size_t TraceReader::Size() const {
+  return size;
+}
@@ -0,0 +1,148 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "RingBuffer.h"
+
+/*
+* One telemetry frame and what the controller did with it.
+* Fixed size, so a trace file can be used in place through mmap.
+*/
+struct trace_record {
+  ///* receive time (ns, steady clock)
+  int64_t timestamp;
+
+  ///* telemetry
+  double cte;
+  double speed;
+  double steering_angle;
+
+  ///* reply
+  double steer_value;
+  double throttle;
+
+  ///* PID state after the update
+  double p_error;
+  double i_error;
+  double d_error;
+  double Kp;
+  double Ki;
+  double Kd;
+
+  ///* Twiddle state
+  double avg_error;
+  double best_error;
+  int32_t twiddle_used;
+  int32_t twiddle_it;
+  int32_t param_index;
+  int32_t dist_count;
+};
+
+static_assert(sizeof(trace_record) == 128, "trace_record layout changed");
+
+/*
+* File header, followed by the records
+*/
+struct trace_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint8_t reserved[48];
+};
+
+const char TRACE_MAGIC[8] = { 'P', 'I', 'D', 'T', 'R', 'A', 'C', 'E' };
+const uint32_t TRACE_VERSION = 1;
+
+/*
+* Appends records to a trace file from a background thread. Write() never
+* blocks: records are dropped (and counted) when the thread falls behind.
+*/
+class TraceWriter {
+public:
+
+  ///* records dropped because the ring was full, or their write failed
+  std::atomic<uint64_t> dropped;
+
+  /*
+  * Constructor: opens (appends to) the trace file. An existing file must
+  * be a trace of this version (check IsOpen()); a partly written last
+  * record is cut off first.
+  */
+  TraceWriter(const std::string &path);
+
+  /*
+  * Destructor: writes the remaining records and closes the file.
+  */
+  virtual ~TraceWriter();
+
+  bool IsOpen() const;
+
+  void Write(const trace_record &record) {
+    if (!ring.Push(record)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  int fd;
+
+  ///* bytes of whole records (and header) in the file
+  uint64_t length;
+
+  std::atomic<bool> running;
+  RingBuffer<trace_record, 8192> ring;
+  std::thread thread;
+
+  void Run();
+
+  /*
+  * Append n records. On a failed or short write, the file is cut back to
+  * its last whole record and the records not written are dropped.
+  */
+  void Append(const trace_record *records, size_t n);
+};
+
+/*
+* Read-only view of a trace file through mmap, no parsing
+*/
+class TraceReader {
+public:
+
+  /*
+  * Constructor: maps the file, check IsOpen()
+  */
+  TraceReader(const std::string &path);
+
+  /*
+  * Destructor.
+  */
+  virtual ~TraceReader();
+
+  bool IsOpen() const;
+
+  size_t Size() const;
+
+  const trace_record &operator[](size_t i) const {
+    return records[i];
+  }
+
+  const trace_record *begin() const {
+    return records;
+  }
+
+  const trace_record *end() const {
+    return records + size;
+  }
+
+private:
+  void *data;
+  size_t length;
+  const trace_record *records;
+  size_t size;
+};
+
+#endif /* TRACE_H */
@@ -0,0 +1,84 @@
+#include "Track.h"
+
+#include <math.h>
+
+Track::Track() {
+  this->half_width = 4.0;
+
+  // Corner radii r1..r4, the last two straights close the loop:
+  // C = A + r1 - r2 - r3 + r4, D = B + r1 + r2 - r3 - r4
+  const double r[4] = { 30.0, 80.0, 45.0, 120.0 };
+  const double A = 400.0, B = 150.0;
+  const double C = A + r[0] - r[1] - r[2] + r[3];
+  const double D = B + r[0] + r[1] - r[2] - r[3];
+
+  x.push_back(0.0);
+  y.push_back(0.0);
+  heading.push_back(0.0);
+
+  AddStraight(A);
+  AddCorner(r[0]);
+  AddStraight(B);
+  AddCorner(r[1]);
+  AddStraight(C);
+  AddCorner(r[2]);
+  AddStraight(D);
+  AddCorner(r[3]);
+
+  // The last point is back on the first one
+  x.pop_back();
+  y.pop_back();
+  heading.pop_back();
+}
+
+Track::~Track() {}
+
+double Track::Length() const {
+  return x.size();
+}
+
+void Track::AddStraight(double length) {
+  const double psi = heading.back();
+  const int n = static_cast<int>(round(length));
+  for (int i = 0; i < n; i++) {
+    x.push_back(x.back() + cos(psi) * length / n);
+    y.push_back(y.back() + sin(psi) * length / n);
+    heading.push_back(psi);
+  }
+}
+
+void Track::AddCorner(double radius) {
+  // 90 degrees to the left
+  const double psi0 = heading.back();
+  const double cx = x.back() - sin(psi0) * radius;
+  const double cy = y.back() + cos(psi0) * radius;
+  const int n = static_cast<int>(round(M_PI / 2 * radius));
+  for (int i = 1; i <= n; i++) {
+    const double psi = psi0 + M_PI / 2 * i / n;
+    x.push_back(cx + sin(psi) * radius);
+    y.push_back(cy - cos(psi) * radius);
+    heading.push_back(psi);
+  }
+}
+
+double Track::CrossTrackError(double px, double py, int &index) const {
+  const int n = x.size();
+
+  // The car moves less than a few meters per frame: search around the last point
+  double best = INFINITY;
+  int best_index = index;
+  for (int k = -8; k <= 8; k++) {
+    const int i = ((index + k) % n + n) % n;
+    const double d = (px - x[i])*(px - x[i]) + (py - y[i])*(py - y[i]);
+    if (d < best) {
+      best = d;
+      best_index = i;
+    }
+  }
+  index = best_index;
+
+  // Distance to the segment direction: right of the heading is positive
+  const double dx = px - x[index];
+  const double dy = py - y[index];
+  return sin(heading[index]) * dx - cos(heading[index]) * dy;
+}
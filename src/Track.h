@@ -0,0 +1,47 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <vector>
+
+/*
+* Closed track: center line sampled every meter
+*/
+class Track {
+public:
+
+  ///* center line points
+  std::vector<double> x;
+  std::vector<double> y;
+
+  ///* heading of the center line at each point (rad)
+  std::vector<double> heading;
+
+  ///* half of the road width (m)
+  double half_width;
+
+  /*
+  * Constructor: rounded rectangle with 4 different corner radii,
+  * about 1.5km long (one lap ~ 2000 telemetry frames at 0.3 throttle)
+  */
+  Track();
+
+  /*
+  * Destructor.
+  */
+  virtual ~Track();
+
+  double Length() const;
+
+  /*
+  * Signed distance to the center line (> 0 on the right side, like the
+  * simulator's cte). index is the nearest point, updated with a local search.
+  */
+  double CrossTrackError(double px, double py, int &index) const;
+
+private:
+  void AddStraight(double length);
+
+  void AddCorner(double radius);
+};
+
+#endif /* TRACK_H */
@@ -1,14 +1,16 @@
 #include "Twiddle.h"
 
-#include <iostream>
+#include <algorithm>
 #include <math.h>
+#include <string.h>
+#include <future>
 
 Twiddle::Twiddle(int max_dist) {
   this->is_used = max_dist == -1 ? false : true;
   this->is_initialized = false;
   this->it = 0;
-  // Twiddle parameters
-  this->nb_params = 5;
+  // Twiddle parameters, see AddParameter
+  this->nb_params = 0;
   this->param_index = 0;
   // Distance
   this->max_dist = max_dist;
@@ -18,21 +20,28 @@ Twiddle::Twiddle(int max_dist) {
   this->error = 0.0;
   this->avg_error = 0.0;
   this->best_error = INFINITY;
-
-  // Initialize dp parameters
-  for (int i = 0; i < this->nb_params; i++) {
-    dp_state init = { 1.0, DIRECTION::FORWARD };
-    this->dp.push_back(init);
+  // No allocation while running (see Pruner)
+  if (max_dist > 0) {
+    this->curve.reserve(max_dist / PRUNE_INTERVAL + 2);
   }
 }
 
 Twiddle::~Twiddle() {}
 
-void Twiddle::Init(PID &pid) {
+void Twiddle::AddParameter(const std::string &name, double *param, double dp_value) {
+  dp_state init = { dp_value, DIRECTION::FORWARD };
+  names.push_back(name);
+  params.push_back(param);
+  dp.push_back(init);
+  nb_params = params.size();
+}
+
+void Twiddle::Init() {
   // Set best error
   best_error = avg_error;
   // Set best dist
   best_dist = dist_count;
+  pruner.SetBest(curve, dist_count, max_dist);
   // Initialization is done!
   is_initialized = true;
 }
@@ -42,20 +51,17 @@ void Twiddle::UpdateBestError() {
   best_error = avg_error;
   // Set current distance count as the best one
   best_dist = dist_count;
+  pruner.SetBest(curve, dist_count, max_dist);
   // Increase the PID parameter change
   dp[param_index].value *= 1.1;
   // Reset direction to forward
   dp[param_index].direction = DIRECTION::FORWARD;
 }
 
-void Twiddle::GoBackward(PID &pid) {
+void Twiddle::GoBackward() {
   // Change direction (fwd --> bwd) for parameter optimization
   // by substracting the change 2 times
-  switch(param_index) {
-    case 0: pid.Kp -= 2*dp[param_index].value; break;
-    case 1: pid.Ki -= 2*dp[param_index].value; break;
-    case 2: pid.Kd -= 2*dp[param_index].value; break;
-  }
+  *params[param_index] -= 2*dp[param_index].value;
   dp[param_index].direction = DIRECTION::BACKWARD;
 }
 
@@ -64,27 +70,306 @@ void Twiddle::ChangePIDIndex() {
   param_index = (param_index + 1) % nb_params;
 }
 
-void Twiddle::UpdatePIDParameter(PID &pid) {
-  // Add change to current PID parameter
-  switch(param_index) {
-    case 0: pid.Kp += dp[param_index].value; break;
-    case 1: pid.Ki += dp[param_index].value; break;
-    case 2: pid.Kd += dp[param_index].value; break;
-  }
+void Twiddle::UpdatePIDParameter() {
+  // Add change to current parameter
+  *params[param_index] += dp[param_index].value;
 }
 
-void Twiddle::ResetPIDParameter(PID &pid) {
-  UpdatePIDParameter(pid);
+void Twiddle::ResetPIDParameter() {
+  UpdatePIDParameter();
   // Decrease the PID parameter change
   dp[param_index].value *= 0.9;
   // Reset direction to forward
   dp[param_index].direction = DIRECTION::FORWARD;
 }
 
+void Twiddle::SetOptimizer(Optimizer *optimizer) {
+  search.reset(optimizer);
+  SetValues(search->Ask());
+}
+
+bool Twiddle::Step(double cte, double speed, Logger &log) {
+  if (Converged()) {
+    // Stop Twiddle algorithm, and just run the car
+    is_used = false;
+    return false;
+  }
+
+  // Keep the car going
+  dist_count += 1;
+  // Update error
+  error += cte*cte;
+  avg_error = error / dist_count;
+
+  bool over = IsRunOver(dist_count, cte, speed);
+  if (pruner.Update(curve, dist_count, error, over, max_dist)) {
+    // Can't beat the best run: scored as it would likely have ended
+    pruner.Count(curve, max_dist);
+    avg_error = pruner.Projected(curve, max_dist);
+    dist_count = max_dist;
+    error = avg_error * dist_count;
+  }
+  else if (!over) {
+    return false;
+  }
+
+  EndRun(log);
+  return true;
+}
+
+bool Twiddle::IsRunOver(int dist, double cte, double speed) const {
+  // Stop current simulation loop (after the first 50 iterations) when:
+  //  - distance is reached
+  //  - or the car is going off the road (early stopping)
+  //  - or the car doesn't move
+  return dist > 50 && (dist >= max_dist || fabs(cte) >= 4.0 || speed <= 1.0);
+}
+
+void Twiddle::EndRun(Logger &log) {
+  if (!cache.Enabled()) {
+    NextParameters(log);
+    return;
+  }
+
+  run_result result = { avg_error, dist_count, curve, false };
+  cache.Insert(Values(), result);
+  NextParameters(log);
+
+  // Parameters already run: reuse their score
+  while (is_used && !Converged() && cache.Find(Values(), result)) {
+    dist_count = result.dist;
+    avg_error = result.avg_error;
+    error = avg_error * dist_count;
+    curve = result.curve;
+    NextParameters(log);
+  }
+}
+
+void Twiddle::NextParameters(Logger &log) {
+  if (search) {
+    NextSearchParameters(log);
+    return;
+  }
+
+  PrintStepState(log);
+
+  // Initialize twiddle (first run)
+  if (!is_initialized) {
+    Init();
+    log.Init();
+  }
+  // Handle PID parameter changes
+  else {
+    if (avg_error < best_error && dist_count >= best_dist) {
+      // New best error found
+      UpdateBestError();
+      // Change parameter index
+      ChangePIDIndex();
+    }
+    else {
+      // Try going backward if forward did not succeed
+      if (dp[param_index].direction == DIRECTION::FORWARD) {
+        GoBackward();
+      }
+      // In case of both failed (fwd and bwd), reset PID parameter,
+      // decrease the update parameter dp, and switch PID parameter
+      else {
+        ResetPIDParameter();
+        ChangePIDIndex();
+      }
+    }
+  }
+
+  if (dp[param_index].direction == DIRECTION::FORWARD) {
+    // Log info
+    if (param_index == 0) {
+      PrintIterationState(log);
+    }
+    UpdatePIDParameter();
+  }
+
+  // Reset distance, current run error
+  dist_count = 0;
+  error = 0;
+  avg_error = 0;
+  curve.clear();
+}
+
+void Twiddle::NextSearchParameters(Logger &log) {
+  PrintStepState(log);
+
+  // Same score as the coordinate descent, as a single cost
+  run_result result = { avg_error, dist_count };
+  run_result best = { best_error, best_dist };
+  double cost = RunCost(result, max_dist);
+  if (!is_initialized) {
+    Init();
+    log.Init();
+  }
+  else if (cost < RunCost(best, max_dist)) {
+    best_error = avg_error;
+    best_dist = dist_count;
+    pruner.SetBest(curve, dist_count, max_dist);
+  }
+
+  search->Tell(cost);
+  SetValues(search->Done() ? search->Best() : search->Ask());
+  std::vector<double> spread = search->Spread();
+  for (int i = 0; i < nb_params; i++) {
+    dp[i].value = spread[i];
+  }
+  if (search->Iteration() > it || search->Done()) {
+    PrintIterationState(log);
+  }
+
+  // Reset distance, current run error
+  dist_count = 0;
+  error = 0;
+  avg_error = 0;
+  curve.clear();
+}
+
+void Twiddle::SetValues(const std::vector<double> &values) {
+  for (int i = 0; i < nb_params; i++) {
+    *params[i] = values[i];
+  }
+}
+
+void Twiddle::EndRun(const run_result &result, Logger &log) {
+  dist_count = result.dist;
+  avg_error = result.avg_error;
+  error = avg_error * dist_count;
+  curve = result.curve;
+  if (result.pruned) {
+    pruner.Count(curve, max_dist);
+  }
+  EndRun(log);
+}
+
+std::vector<double> Twiddle::Values() const {
+  std::vector<double> values;
+  for (int i = 0; i < nb_params; i++) {
+    values.push_back(*params[i]);
+  }
+  return values;
+}
+
+std::vector<std::vector<double> > Twiddle::Candidates(int count) const {
+  if (search) {
+    return search->Batch();
+  }
+
+  std::vector<std::vector<double> > candidates(1, Values());
+  if (!is_initialized) {
+    return candidates;
+  }
+
+  // Same steps as NextParameters when the run fails
+  std::vector<double> values = Values();
+  std::vector<dp_state> steps = dp;
+  int index = param_index;
+  while (static_cast<int>(candidates.size()) < count) {
+    if (steps[index].direction == DIRECTION::FORWARD) {
+      values[index] -= 2*steps[index].value;
+      steps[index].direction = DIRECTION::BACKWARD;
+    }
+    else {
+      values[index] += steps[index].value;
+      steps[index].value *= 0.9;
+      steps[index].direction = DIRECTION::FORWARD;
+      index = (index + 1) % nb_params;
+      values[index] += steps[index].value;
+    }
+    candidates.push_back(values);
+  }
+  return candidates;
+}
+
+void Twiddle::Run(const Evaluator &evaluate, ThreadPool *pool, Logger &log,
+                  const std::function<void()> &on_end_run) {
+  while (is_used) {
+    if (Converged()) {
+      is_used = false;
+      break;
+    }
+    RunBatch(evaluate, pool, log, on_end_run);
+  }
+}
+
+void Twiddle::RunBatch(const Evaluator &evaluate, ThreadPool *pool, Logger &log,
+                       const std::function<void()> &on_end_run) {
+  std::vector<std::vector<double> > batch = Candidates(pool != nullptr ? pool->Size() : 1);
+  if (pool == nullptr || pool->Size() < 2 || batch.size() < 2) {
+    EndRun(evaluate(Values(), pruner), log);
+    on_end_run();
+    return;
+  }
+
+  // Score the candidates that don't depend on each other's results at the
+  // same time (e.g. a CMA-ES generation, or Twiddle's next failures)
+  Pruner snapshot = pruner;
+  std::vector<std::future<run_result> > results;
+  for (const std::vector<double> &candidate : batch) {
+    if (cache.Contains(candidate)) {
+      results.push_back(std::future<run_result>());
+    } else {
+      results.push_back(pool->Submit([&evaluate, candidate, snapshot]() { return evaluate(candidate, snapshot); }));
+    }
+  }
+
+  // Commit in the serial order, until a result changes the next candidates
+  // (the remaining results are dropped). Cached candidates were already
+  // committed by EndRun
+  for (size_t k = 0; k < batch.size(); k++) {
+    if (!results[k].valid()) {
+      continue;
+    }
+    run_result result = results[k].get();
+    if (is_used && !Converged() && Values() == batch[k]) {
+      EndRun(result, log);
+      on_end_run();
+    }
+  }
+}
+
+void Twiddle::RunBatches(const BatchEvaluator &evaluate, int count, Logger &log,
+                         const std::function<void()> &on_end_run) {
+  while (is_used) {
+    if (Converged()) {
+      is_used = false;
+      break;
+    }
+
+    // Cached candidates are committed by EndRun, as in RunBatch
+    std::vector<std::vector<double> > batch;
+    for (const std::vector<double> &candidate : Candidates(count)) {
+      if (!cache.Contains(candidate)) {
+        batch.push_back(candidate);
+      }
+    }
+    std::vector<run_result> results = evaluate(batch);
+
+    // Commit in the serial order, until a result changes the next candidates
+    for (size_t k = 0; k < batch.size(); k++) {
+      if (is_used && !Converged() && Values() == batch[k]) {
+        EndRun(results[k], log);
+        on_end_run();
+      }
+    }
+  }
+}
+
 bool Twiddle::DistanceReached() {
   return dist_count >= max_dist;
 }
 
+bool Twiddle::Converged() {
+  if (search) {
+    return search->Done();
+  }
+  return SumDp() <= 1E-10;
+}
+
 double Twiddle::SumDp() {
   double sum = 0.0;
   for (int i = 0; i < nb_params; i++) {
@@ -93,29 +378,36 @@ double Twiddle::SumDp() {
   return sum;
 }
 
-void Twiddle::PrintStepState(PID &pid) {
-  std::cout << "p: ("
-            << pid.Kp << ", "
-            << pid.Ki << ", "
-            << pid.Kd << "), ";
-
-  std::cout << "dp: ("
-            << dp[0].value << ", "
-            << dp[1].value << ", "
-            << dp[2].value << "), ";
-
-  std::cout << "avg err: " << avg_error << ", ";
-
-  std::cout << "dist: " << dist_count << std::endl;
+void Twiddle::PrintStepState(Logger &log) {
+  LogRecord record;
+  record.type = LOG_STEP;
+  record.count = std::min(nb_params, LOG_MAX_PARAMS);
+  for (int i = 0; i < record.count; i++) {
+    record.values[i] = *params[i];
+    record.values[record.count + i] = dp[i].value;
+  }
+  record.values[2*record.count] = avg_error;
+  record.values[2*record.count + 1] = dist_count;
+  log.Push(record);
 }
 
-void Twiddle::PrintIterationState(PID &pid) {
-  std::cout << "Iteration " << it++
-            << ", best error: " << best_error
-            << ", best dist: "  << best_dist
-            << " --> "
-            << pid.Kp << "(Kp), "
-            << pid.Ki << "(Ki), "
-            << pid.Kd << "(Kd)\n"
-            << std::endl;
+void Twiddle::PrintIterationState(Logger &log) {
+  LogRecord record;
+  record.type = LOG_ITERATION;
+  record.count = std::min(nb_params, LOG_MAX_PARAMS);
+  record.values[0] = it++;
+  record.values[1] = best_error;
+  record.values[2] = best_dist;
+  record.values[3 + record.count] = cache.hits;
+  record.values[4 + record.count] = cache.misses;
+  record.values[5 + record.count] = pruner.pruned;
+  record.values[6 + record.count] = pruner.saved;
+  // Twiddle's current parameters are its best, a search tells its best
+  std::vector<double> values = search ? search->Best() : Values();
+  for (int i = 0; i < record.count; i++) {
+    record.values[3 + i] = values[i];
+    strncpy(record.names[i], names[i].c_str(), sizeof(record.names[i]) - 1);
+    record.names[i][sizeof(record.names[i]) - 1] = '\0';
+  }
+  log.Push(record);
 }
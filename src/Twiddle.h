@@ -1,8 +1,15 @@
 #ifndef TWIDDLE_H
 #define TWIDDLE_H
 
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
-#include "PID.h"
+#include "Logger.h"
+#include "Optimizer.h"
+#include "Pruner.h"
+#include "RunCache.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -16,6 +23,19 @@ struct dp_state {
   DIRECTION direction;
 };
 
+/*
+* Offline scoring of a candidate: values of the parameters in registration
+* order, and the pruner to stop it early with (a copy when run on a thread
+* pool). Must be thread-safe to be used with a thread pool.
+*/
+typedef std::function<run_result(const std::vector<double> &, const Pruner &)> Evaluator;
+
+/*
+* Offline scoring of several candidates at once (e.g. as the lanes of a
+* PIDBank), one result per candidate
+*/
+typedef std::function<std::vector<run_result>(const std::vector<std::vector<double> > &)> BatchEvaluator;
+
 class Twiddle {
 public:
 
@@ -25,7 +45,7 @@ public:
   ///* initially set to false, set to true in first simulator run
   bool is_initialized;
 
-  ///* number of PID parameters (3 by default)
+  ///* number of parameters to optimize
   int nb_params;
 
   ///* distance already run on the current loop
@@ -46,15 +66,34 @@ public:
   ///* avg error on the current run
   double avg_error;
 
-  ///* index of the current parameters to optimize (p: 0, i: 1, d: 2)
+  ///* total error at the checkpoints of the current run, when pruning
+  std::vector<double> curve;
+
+  ///* index of the current parameters to optimize
   int param_index;
 
-  ///* values used to update each PID parameters in Twiddle algorithm
+  ///* names of the parameters to optimize (Kp, Ki, Kd, throttle...)
+  std::vector<std::string> names;
+
+  ///* parameters to optimize, they are updated in place
+  std::vector<double *> params;
+
+  ///* values used to update each parameters in Twiddle algorithm
   std::vector<dp_state> dp;
 
   ///* iteration number
   int it;
 
+  ///* scores of the parameters already run
+  RunCache cache;
+
+  ///* early termination of the runs that can't beat the best one
+  Pruner pruner;
+
+  ///* search replacing the coordinate descent below (--optimizer), nullptr
+  ///* for Twiddle's own. Episodes are run and scored the same way.
+  std::unique_ptr<Optimizer> search;
+
   /*
   * Constructor
   */
@@ -65,25 +104,110 @@ public:
   */
   virtual ~Twiddle();
 
-  void Init(PID &pid);
+  /*
+  * Add a parameter to optimize, with its initial change
+  */
+  void AddParameter(const std::string &name, double *param, double dp_value);
+
+  void Init();
+
+  /*
+  * Use optimizer (owned) instead of the coordinate descent, from its first
+  * candidate
+  */
+  void SetOptimizer(Optimizer *optimizer);
 
   void UpdateBestError();
 
-  void GoBackward(PID &pid);
+  void GoBackward();
 
   void ChangePIDIndex();
 
-  void UpdatePIDParameter(PID &pid);
+  void UpdatePIDParameter();
+
+  void ResetPIDParameter();
+
+  /*
+  * Feed one telemetry frame to the current run. Returns true when the run
+  * is over: the next parameters are set and the simulator must be reset.
+  */
+  bool Step(double cte, double speed, Logger &log);
+
+  /*
+  * Is the current run over, at distance dist?
+  */
+  bool IsRunOver(int dist, double cte, double speed) const;
+
+  /*
+  * Score the current run (avg_error, dist_count) and set the next parameters.
+  * Parameters found in the cache are scored right away, without a run.
+  */
+  void EndRun(Logger &log);
 
-  void ResetPIDParameter(PID &pid);
+  void EndRun(const run_result &result, Logger &log);
+
+  /*
+  * Current values of the parameters
+  */
+  std::vector<double> Values() const;
+
+  /*
+  * Candidates that can be run before any result comes back, the current
+  * one first: with search, its batch; with Twiddle, the next count ones
+  * assuming every run fails (the likeliest), computed exactly as
+  * NextParameters would.
+  */
+  std::vector<std::vector<double> > Candidates(int count) const;
+
+  /*
+  * Offline optimization: score each candidate with evaluate instead of
+  * telemetry frames. With a pool of 2+ threads, the next Candidates are
+  * scored at the same time; results are committed in the serial order, so
+  * the outcome doesn't depend on threads. on_end_run is called after each
+  * run is scored (e.g. to checkpoint).
+  */
+  void Run(const Evaluator &evaluate, ThreadPool *pool, Logger &log,
+           const std::function<void()> &on_end_run);
+
+  /*
+  * Score the next Candidates on the pool at once, commit the results in
+  * order until one of them changes the next candidates
+  */
+  void RunBatch(const Evaluator &evaluate, ThreadPool *pool, Logger &log,
+                const std::function<void()> &on_end_run);
+
+  /*
+  * Same as Run, the next Candidates (up to count) being scored by one call
+  * of evaluate
+  */
+  void RunBatches(const BatchEvaluator &evaluate, int count, Logger &log,
+                  const std::function<void()> &on_end_run);
 
   bool DistanceReached();
 
   double SumDp();
 
-  void PrintStepState(PID &pid);
+  /*
+  * Optimization over: dp below 1E-10, or search done
+  */
+  bool Converged();
+
+  /*
+  * Score the current parameters and move to the next ones
+  */
+  void NextParameters(Logger &log);
+
+  /*
+  * NextParameters with search: tell the score, run the next candidate (the
+  * best one once done)
+  */
+  void NextSearchParameters(Logger &log);
+
+  void SetValues(const std::vector<double> &values);
+
+  void PrintStepState(Logger &log);
 
-  void PrintIterationState(PID &pid);
+  void PrintIterationState(Logger &log);
 };
 
 #endif /* TWIDDLE_H */
@@ -0,0 +1,53 @@
+#include "Vehicle.h"
+
+#include <math.h>
+
+Vehicle::Vehicle(const Track &track) : track(track) {
+  this->dt = 0.05;
+  this->wheelbase = 2.67;
+  this->max_steer = 25.0 * M_PI / 180;
+  this->steer_tau = 0.2;
+  // steady state speed: throttle * max_accel / drag, 15 m/s at 0.3
+  this->max_accel = 10.0;
+  this->drag = 0.2;
+  Reset();
+}
+
+Vehicle::~Vehicle() {}
+
+void Vehicle::Reset() {
+  index = 0;
+  x = track.x[0];
+  y = track.y[0];
+  psi = track.heading[0];
+  v = 0.0;
+  delta = 0.0;
+}
+
+void Vehicle::Step(double steering, double throttle) {
+  if (steering > 1.0) {
+    steering = 1.0;
+  }
+  if (steering < -1.0) {
+    steering = -1.0;
+  }
+  // The wheels don't turn instantly
+  delta += (steering * max_steer - delta) * dt / steer_tau;
+
+  x += v * cos(psi) * dt;
+  y += v * sin(psi) * dt;
+  // Steering to the right turns clockwise
+  psi -= v / wheelbase * tan(delta) * dt;
+  v += (throttle * max_accel - drag * v) * dt;
+  if (v < 0.0) {
+    v = 0.0;
+  }
+}
+
+Telemetry Vehicle::Read() {
+  Telemetry telemetry;
+  telemetry.cte = track.CrossTrackError(x, y, index);
+  telemetry.speed = v * 2.23694;
+  telemetry.steering_angle = delta * 180 / M_PI;
+  return telemetry;
+}
@@ -0,0 +1,69 @@
+#ifndef VEHICLE_H
+#define VEHICLE_H
+
+#include "Codec.h"
+#include "Track.h"
+
+/*
+* Kinematic bicycle model driving on a Track, producing the same telemetry
+* as the simulator (cte in m, speed in mph, steering angle in degrees)
+*/
+class Vehicle {
+public:
+
+  ///* position (m), heading (rad), speed (m/s)
+  double x;
+  double y;
+  double psi;
+  double v;
+
+  ///* steering angle (rad)
+  double delta;
+
+  ///* nearest center line point
+  int index;
+
+  ///* time step (s) between two telemetry frames
+  double dt;
+
+  ///* distance between front and rear axles (m)
+  double wheelbase;
+
+  ///* maximum steering angle (rad), for a steering value of 1
+  double max_steer;
+
+  ///* steering actuator time constant (s)
+  double steer_tau;
+
+  ///* acceleration (m/s^2) for a throttle of 1, and linear drag (1/s)
+  double max_accel;
+  double drag;
+
+  /*
+  * Constructor
+  */
+  Vehicle(const Track &track);
+
+  /*
+  * Destructor.
+  */
+  virtual ~Vehicle();
+
+  /*
+  * Put the car back on the start line, stopped
+  */
+  void Reset();
+
+  /*
+  * Apply the controls for one time step
+  * (steering value in [-1, 1], positive steers to the right)
+  */
+  void Step(double steering, double throttle);
+
+  Telemetry Read();
+
+private:
+  const Track &track;
+};
+
+#endif /* VEHICLE_H */
@@ -0,0 +1,312 @@
+#include <benchmark/benchmark.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Codec.h"
+#include "FixedPoint.h"
+#include "GainSchedule.h"
+#include "Logger.h"
+#include "PID.h"
+#include "PIDBank.h"
+#include "ReplayScorer.h"
+#include "Track.h"
+#include "Twiddle.h"
+#include "Vehicle.h"
+#include "json.hpp"
+
+// for convenience
+using json = nlohmann::json;
+
+// Hot path microbenchmarks. Save results to diff between commits with:
+//   ./pid_bench --benchmark_out=bench.json --benchmark_out_format=json
+
+namespace {
+
+// Telemetry from a lap of the vehicle model, driven with tuned gains
+std::vector<Telemetry> CannedTelemetry() {
+  Track track;
+  Vehicle car(track);
+  PID pid;
+  pid.Init(0.30351, 0.00001, 2.66123);
+
+  std::vector<Telemetry> frames;
+  for (int i = 0; i < 2000; i++) {
+    Telemetry telemetry = car.Read();
+    frames.push_back(telemetry);
+    pid.UpdateError(telemetry.cte);
+    car.Step(-pid.TotalError(), 0.3);
+  }
+  return frames;
+}
+
+const std::vector<Telemetry> &Frames() {
+  static const std::vector<Telemetry> frames = CannedTelemetry();
+  return frames;
+}
+
+// The same frames as the simulator sends them
+const std::vector<std::string> &Messages() {
+  static std::vector<std::string> messages;
+  if (messages.empty()) {
+    for (const Telemetry &telemetry : Frames()) {
+      Message msg;
+      EncodeTelemetry(telemetry, 0.3, msg);
+      messages.push_back(std::string(msg.data, msg.length));
+    }
+  }
+  return messages;
+}
+
+// Replay of 4 recorded laps, with the lateral model fitted on them
+const ReplayScorer &CannedReplay() {
+  static ReplayScorer replay(2000);
+  if (replay.segments.empty()) {
+    Track track;
+    const double Kd[4] = { 2.0, 2.66123, 3.5, 5.0 };
+    for (double kd : Kd) {
+      Vehicle car(track);
+      PID pid;
+      pid.Init(0.30351, 0.00001, kd);
+      replay_segment segment;
+      for (int i = 0; i < 2000; i++) {
+        Telemetry telemetry = car.Read();
+        pid.UpdateError(telemetry.cte);
+        double steer_value = -pid.TotalError();
+        segment.cte.push_back(telemetry.cte);
+        segment.speed.push_back(telemetry.speed);
+        segment.steer.push_back(steer_value);
+        if (i == 1) {
+          segment.p_error = pid.p_error;
+          segment.i_error = pid.i_error;
+          segment.d_error = pid.d_error;
+        }
+        car.Step(steer_value, 0.3);
+      }
+      replay.segments.push_back(segment);
+    }
+    replay.Fit();
+  }
+  return replay;
+}
+
+}  // namespace
+
+static void BM_PIDUpdate(benchmark::State &state) {
+  const std::vector<Telemetry> &frames = Frames();
+  PID pid;
+  pid.Init(0.30351, 0.00001, 2.66123);
+  size_t i = 0;
+  for (auto _ : state) {
+    pid.UpdateError(frames[i].cte);
+    benchmark::DoNotOptimize(pid.TotalError());
+    i = (i + 1) % frames.size();
+  }
+}
+BENCHMARK(BM_PIDUpdate);
+
+// Same, with the gains looked up in a full speed schedule on every frame
+static void BM_ScheduledPIDUpdate(benchmark::State &state) {
+  const std::vector<Telemetry> &frames = Frames();
+  GainSchedule schedule;
+  schedule.size = SCHEDULE_MAX_POINTS;
+  for (int k = 0; k < SCHEDULE_MAX_POINTS; k++) {
+    schedule.speed[k] = 10.0 * k;
+    schedule.Kp[k] = 0.4 - 0.02 * k;
+    schedule.Ki[k] = 0.00001;
+    schedule.Kd[k] = 2.0 + 0.2 * k;
+  }
+  schedule.Update();
+
+  PID pid;
+  pid.Init(0.30351, 0.00001, 2.66123);
+  size_t i = 0;
+  for (auto _ : state) {
+    schedule.Apply(pid, frames[i].speed);
+    pid.UpdateError(frames[i].cte);
+    benchmark::DoNotOptimize(pid.TotalError());
+    i = (i + 1) % frames.size();
+  }
+}
+BENCHMARK(BM_ScheduledPIDUpdate);
+
+// PD controller (Ki = 0) specialized at compile time
+struct TunedGains {
+  static constexpr double Kp = 0.30351;
+  static constexpr double Ki = 0.0;
+  static constexpr double Kd = 2.66123;
+};
+
+template<typename Controller, typename T>
+static void BM_BasicPIDUpdate(benchmark::State &state) {
+  const std::vector<Telemetry> &frames = Frames();
+  std::vector<T> cte;
+  for (const Telemetry &telemetry : frames) {
+    cte.push_back(T(telemetry.cte));
+  }
+  Controller pid;
+  pid.Init(T(0.30351), T(0.0), T(2.66123));
+  size_t i = 0;
+  for (auto _ : state) {
+    pid.UpdateError(cte[i]);
+    benchmark::DoNotOptimize(pid.TotalError());
+    i = (i + 1) % cte.size();
+  }
+}
+BENCHMARK_TEMPLATE(BM_BasicPIDUpdate, BasicPID<double, PID_TERMS_PD>, double);
+BENCHMARK_TEMPLATE(BM_BasicPIDUpdate, BasicPID<double, PID_TERMS_PD, NoClamp>, double);
+BENCHMARK_TEMPLATE(BM_BasicPIDUpdate, BasicPID<float>, float);
+BENCHMARK_TEMPLATE(BM_BasicPIDUpdate, BasicPID<FixedPoint<16> >, FixedPoint<16>);
+
+static void BM_BasicPIDConstGains(benchmark::State &state) {
+  const std::vector<Telemetry> &frames = Frames();
+  BasicPID<double, PID_TERMS_PD, ClampOutput, TunedGains> pid;
+  pid.Init();
+  size_t i = 0;
+  for (auto _ : state) {
+    pid.UpdateError(frames[i].cte);
+    benchmark::DoNotOptimize(pid.TotalError());
+    i = (i + 1) % frames.size();
+  }
+}
+BENCHMARK(BM_BasicPIDConstGains);
+
+// N controllers, one frame each: PID objects against the PIDBank backends
+static void BM_PIDObjects(benchmark::State &state) {
+  const std::vector<Telemetry> &frames = Frames();
+  std::vector<PID> pids(state.range(0));
+  std::vector<double> out(pids.size());
+  for (size_t k = 0; k < pids.size(); k++) {
+    pids[k].Init(0.3 + 1e-4 * k, 0.00001, 2.66123);
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    for (size_t k = 0; k < pids.size(); k++) {
+      pids[k].UpdateError(frames[(i + k) % frames.size()].cte);
+      out[k] = pids[k].TotalError();
+    }
+    benchmark::DoNotOptimize(out.data());
+    i = (i + 1) % frames.size();
+  }
+  state.SetItemsProcessed(state.iterations() * pids.size());
+}
+BENCHMARK(BM_PIDObjects)->Arg(1024)->Arg(65536);
+
+static void BM_PIDBank(benchmark::State &state, BACKEND backend) {
+  if (backend > PIDBank::BestBackend()) {
+    state.SkipWithError("not supported by this CPU");
+    return;
+  }
+  const std::vector<Telemetry> &frames = Frames();
+  PIDBank bank(state.range(0));
+  bank.backend = backend;
+  for (size_t k = 0; k < bank.size; k++) {
+    bank.Init(k, 0.3 + 1e-4 * k, 0.00001, 2.66123);
+  }
+  // cte of every frame, repeated so any window of bank.size values is contiguous
+  std::vector<double> cte(frames.size() + bank.size);
+  for (size_t k = 0; k < cte.size(); k++) {
+    cte[k] = frames[k % frames.size()].cte;
+  }
+  std::vector<double> out(bank.size);
+  size_t i = 0;
+  for (auto _ : state) {
+    bank.UpdateError(&cte[i]);
+    bank.TotalError(out.data());
+    benchmark::DoNotOptimize(out.data());
+    i = (i + 1) % frames.size();
+  }
+  state.SetItemsProcessed(state.iterations() * bank.size);
+}
+BENCHMARK_CAPTURE(BM_PIDBank, scalar, BACKEND_SCALAR)->Arg(1024)->Arg(65536);
+BENCHMARK_CAPTURE(BM_PIDBank, avx2, BACKEND_AVX2)->Arg(1024)->Arg(65536);
+BENCHMARK_CAPTURE(BM_PIDBank, avx512, BACKEND_AVX512)->Arg(1024)->Arg(65536);
+
+static void BM_TwiddleEndRun(benchmark::State &state) {
+  // Log records are formatted into a stream without buffer (discarded)
+  std::ostream null(nullptr);
+  Logger log(null);
+  PID pid;
+  pid.Init(0.3, 0.0, 2.6);
+  double throttle = 0.3;
+  Twiddle tw(2000);
+  tw.AddParameter("Kp", &pid.Kp, 1.0);
+  tw.AddParameter("Ki", &pid.Ki, 1.0);
+  tw.AddParameter("Kd", &pid.Kd, 1.0);
+  tw.AddParameter("throttle", &throttle, 0.1);
+
+  // Alternate better and worse runs so every branch is taken
+  int k = 0;
+  for (auto _ : state) {
+    run_result result = { (k++ % 3) == 0 ? 0.01 : 1.0, 2000 };
+    tw.EndRun(result, log);
+    benchmark::DoNotOptimize(pid.Kp);
+  }
+}
+BENCHMARK(BM_TwiddleEndRun);
+
+static void BM_ParseEvent(benchmark::State &state) {
+  const std::vector<std::string> &messages = Messages();
+  size_t i = 0;
+  for (auto _ : state) {
+    Telemetry telemetry;
+    benchmark::DoNotOptimize(ParseEvent(messages[i].data(), messages[i].size(), telemetry));
+    benchmark::DoNotOptimize(telemetry);
+    i = (i + 1) % messages.size();
+  }
+}
+BENCHMARK(BM_ParseEvent);
+
+static void BM_ParseTelemetry(benchmark::State &state) {
+  const std::vector<std::string> &messages = Messages();
+  size_t i = 0;
+  for (auto _ : state) {
+    Telemetry telemetry;
+    benchmark::DoNotOptimize(ParseTelemetry(messages[i].data(), messages[i].size(), telemetry));
+    benchmark::DoNotOptimize(telemetry);
+    i = (i + 1) % messages.size();
+  }
+}
+BENCHMARK(BM_ParseTelemetry);
+
+static void BM_EncodeSteerJson(benchmark::State &state) {
+  const std::vector<Telemetry> &frames = Frames();
+  size_t i = 0;
+  for (auto _ : state) {
+    json msgJson;
+    msgJson["steering_angle"] = -frames[i].steering_angle / 25.0;
+    msgJson["throttle"] = 0.3;
+    auto msg = "42[\"steer\"," + msgJson.dump() + "]";
+    benchmark::DoNotOptimize(msg.data());
+    i = (i + 1) % frames.size();
+  }
+}
+BENCHMARK(BM_EncodeSteerJson);
+
+static void BM_EncodeSteer(benchmark::State &state) {
+  const std::vector<Telemetry> &frames = Frames();
+  Message msg;
+  size_t i = 0;
+  for (auto _ : state) {
+    EncodeSteer(-frames[i].steering_angle / 25.0, 0.3, msg);
+    benchmark::DoNotOptimize(msg);
+    i = (i + 1) % frames.size();
+  }
+}
+BENCHMARK(BM_EncodeSteer);
+
+// Candidates scored on the recorded laps, per candidate frame
+static void BM_ReplayScore(benchmark::State &state) {
+  const ReplayScorer &replay = CannedReplay();
+  std::vector<pid_gains> gains;
+  for (int k = 0; k < state.range(0); k++) {
+    pid_gains candidate = { 0.1 + 0.4 * k / state.range(0), 0.0001, 3.0, -1.0, 1.0 };
+    gains.push_back(candidate);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(replay.Score(gains, nullptr));
+  }
+  state.SetItemsProcessed(state.iterations() * gains.size() * replay.Frames());
+}
+BENCHMARK(BM_ReplayScore)->Arg(1)->Arg(64)->Arg(1024);
+
+BENCHMARK_MAIN();
@@ -1,9 +1,21 @@
 #include <uWS/uWS.h>
+#include <uv.h>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "AllocCounter.h"
+#include "Checkpoint.h"
+#include "Coordinator.h"
+#include "Codec.h"
+#include "GainStore.h"
 #include "json.hpp"
-#include "PID.h"
-#include "Twiddle.h"
+#include "Metrics.h"
+#include "Options.h"
+#include "Session.h"
 #include <math.h>
+#include <unistd.h>
 
 // for convenience
 using json = nlohmann::json;
@@ -13,174 +25,218 @@ constexpr double pi() { return M_PI; }
 double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-std::string hasData(std::string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.find_last_of("]");
-  if (found_null != std::string::npos) {
-    return "";
-  }
-  else if (b1 != std::string::npos && b2 != std::string::npos) {
-    return s.substr(b1, b2 - b1 + 1);
+// Send the steering values encoded by the session, and time the frame
+void send_steer(Session &session, uWS::WebSocket<uWS::SERVER> ws, uint64_t received, uint64_t &t) {
+  Message &msg = session.msg;
+  ws.send(msg.data, msg.length, uWS::OpCode::TEXT);
+  session.metrics.Lap(STAGE_SEND, t);
+  session.metrics.stages[STAGE_TOTAL].Record(t - received);
+}
+
+// Publish the gains of the query (if any), reply with the current gains.
+// locked: why they can't be changed, nullptr if they can
+std::string handle_gains(GainStore &gains, const char *locked, const std::string &query) {
+  pid_gains current = gains.Load();
+  if (!query.empty()) {
+    if (locked != nullptr) {
+      return std::string("error: ") + locked + "\n";
+    }
+    if (!ParseGainsQuery(query, current)) {
+      return "error: invalid gains (Kp, Ki, Kd, min < max)\n";
+    }
+    gains.Publish(current);
   }
-  return "";
+
+  json gainsJson;
+  gainsJson["Kp"] = current.Kp;
+  gainsJson["Ki"] = current.Ki;
+  gainsJson["Kd"] = current.Kd;
+  gainsJson["min"] = current.min_output_limit;
+  gainsJson["max"] = current.max_output_limit;
+  return gainsJson.dump() + "\n";
 }
 
-void run_car(Twiddle tw, PID &pid, double cte, uWS::WebSocket<uWS::SERVER> ws) {
-  // Predict steering angle from errors
-  pid.UpdateError(cte);
-  double steer_value = -pid.TotalError();
+// Session of a connection and its trace file
+struct connection {
+  std::unique_ptr<Session> session;
+  std::unique_ptr<TraceWriter> trace;
+};
 
-  double throttle = 0.3;
+// Hub and state of one serving thread. A connection, and the session it
+// drives, stay on the thread that accepted it: the control path takes no lock
+struct worker {
+  uWS::Hub h;
+  Logger log;
+  Metrics metrics;
+  // by session id (the ids are shared by all threads)
+  std::vector<connection> connections;
+  // sessions with a frame to reply to at the end of the loop iteration
+  std::vector<std::pair<Session*, uWS::WebSocket<uWS::SERVER> > > pending;
+  uv_check_t check;
 
-  json msgJson;
-  msgJson["steering_angle"] = steer_value;
-  msgJson["throttle"] = throttle;
-  auto msg = "42[\"steer\"," + msgJson.dump() + "]";
+  worker() : log(std::cout) {}
+};
 
-  // Log info: only in running mode
-  if (!tw.is_used) {
-    std::cout << "CTE: " << cte << " Steering Value: " << steer_value << " Throttle: " << throttle << std::endl;
-    std::cout << msg << std::endl;
+// --coalesce: runs after the loop has dispatched the frames received
+// together; only the newest frame of each session gets a reply
+void reply_pending(uv_check_t *check) {
+  worker &w = *static_cast<worker*>(check->data);
+  for (const std::pair<Session*, uWS::WebSocket<uWS::SERVER> > &entry : w.pending) {
+    Session &session = *entry.first;
+    session.log.source = session.id;
+    uint64_t received = session.pending_received;
+    uint64_t t = Metrics::Now();
+    session.SteerPending(t);
+    send_steer(session, entry.second, received, t);
   }
-
-  ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+  w.pending.clear();
 }
 
-void reset_simulator(uWS::WebSocket<uWS::SERVER> ws) {
-  std::string msg = "42[\"reset\",{}]";
-  ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-}
+// State shared by the serving threads: thread-safe, or read only once serving
+struct server {
+  Options options;
+  bool tuning;
+  std::unique_ptr<GainStore> gains;
+  SessionIds ids;
+  // --farm: the optimization run by every simulator, and its log
+  std::unique_ptr<Logger> farm_log;
+  std::unique_ptr<Session> tuner;
+  std::unique_ptr<Coordinator> farm;
+  std::vector<std::unique_ptr<worker>> workers;
+};
 
-int main(int argc, char *argv[])
-{
-  uWS::Hub h;
+// New session on the lowest free id, so that the first simulator always
+// uses the checkpoint / trace files given in the options (see SessionPath)
+Session *open_session(worker &w, server &s) {
+  const Options &options = s.options;
+  int id = s.ids.Acquire();
+  if (static_cast<size_t>(id) >= w.connections.size()) {
+    w.connections.resize(id + 1);
+  }
 
-  PID pid;
-  // Initialize the pid variable
-  double Kp = 0.0;
-  if (argc > 2) {
-    Kp = atof(argv[2]);
+  std::unique_ptr<Session> session(new Session(w.log, w.metrics, options));
+  session->id = id;
+  session->gains = s.tuning ? nullptr : s.gains.get();
+
+  // Farm: the tuner holds the optimization, checkpoint and schedule included
+  if (s.farm) {
+    session->checkpoint.clear();
+    session->schedule_file.clear();
+    session->JoinFarm(s.farm.get());
   }
-  double Ki = 0.0;
-  if (argc > 3) {
-    Ki = atof(argv[3]);
+  else {
+    session->checkpoint = SessionPath(options.checkpoint, id);
+    session->schedule_file = SessionPath(session->schedule_file, id);
+
+    // The other sessions start from scratch when they have no checkpoint yet
+    std::string resume = SessionPath(options.resume, id);
+    bool exists = access(resume.c_str(), F_OK) == 0;
+    if (!resume.empty() && (id == 0 || exists) &&
+        !LoadCheckpoint(resume, session->tw, session->pid, session->schedule_file, session->breakpoint)) {
+      s.ids.Release(id);
+      return nullptr;
+    }
   }
-  double Kd = 0.0;
-  if (argc > 4) {
-    Kd = atof(argv[4]);
+
+  std::unique_ptr<TraceWriter> trace;
+  std::string path = SessionPath(options.trace, id);
+  if (!path.empty()) {
+    trace.reset(new TraceWriter(path));
+    if (!trace->IsOpen()) {
+      std::cerr << "Cannot open trace file " << path << std::endl;
+      session->LeaveFarm();
+      s.ids.Release(id);
+      return nullptr;
+    }
+    session->trace = trace.get();
   }
 
-  pid.Init(Kp, Ki, Kd);
+  w.connections[id].session = std::move(session);
+  w.connections[id].trace = std::move(trace);
+  return w.connections[id].session.get();
+}
 
-  // Initialize the twiddle variable
-  // if -1 don't use Twiddle
-  Twiddle tw(atoi(argv[1]));
+void close_session(worker &w, server &s, int id) {
+  // Its farm candidate (if any) goes to another simulator
+  w.connections[id].session->LeaveFarm();
+  w.connections[id].session.reset();
+  w.connections[id].trace.reset();
+  s.ids.Release(id);
+}
 
+void reset_simulator(uWS::WebSocket<uWS::SERVER> ws) {
+  ws.send(RESET_MESSAGE, sizeof(RESET_MESSAGE) - 1, uWS::OpCode::TEXT);
+}
 
-  h.onMessage([&pid, &tw](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
-    // "42" at the start of the message means there's a websocket message event.
-    // The 4 signifies a websocket message
-    // The 2 signifies a websocket event
-    if (length && length > 2 && data[0] == '4' && data[1] == '2')
-    {
-      auto s = hasData(std::string(data).substr(0, length));
-      if (s != "") {
-        auto j = json::parse(s);
-        std::string event = j[0].get<std::string>();
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          double cte = std::stod(j[1]["cte"].get<std::string>());
-          double speed = std::stod(j[1]["speed"].get<std::string>());
-          //double angle = std::stod(j[1]["steering_angle"].get<std::string>());
-
-          if (tw.is_used && tw.SumDp() <= 1E-10) {
-            // Stop Twiddle algorithm, and just run the car
-            tw.is_used = false;
-          }
-
-          // Use parameters optimization (twiddle)
-          if (tw.is_used) {
-
-            // Keep the car going
-            tw.dist_count += 1;
-            // Update error
-            tw.error += cte*cte;
-            tw.avg_error = tw.error / tw.dist_count;
-
-            // Stop current simulation loop (after the first 50 iterations) when:
-            //  - distance is reached
-            //  - or the car is going off the road (early stopping)
-            //  - or the car doesn't move
-            if (tw.dist_count > 50 && (tw.DistanceReached() || std::fabs(cte) >= 4.0 || speed <= 1.0)) {
-
-              tw.PrintStepState(pid);
-
-              // Initialize twiddle (first run)
-              if (!tw.is_initialized) {
-                tw.Init(pid);
-                std::cout << "Initialization is done!" << std::endl;
-              }
-              // Handle PID parameter changes
-              else {
-                if(tw.avg_error < tw.best_error && tw.dist_count >= tw.best_dist) {
-                  // New best error found
-                  tw.UpdateBestError();
-                  // Change parameter index
-                  tw.ChangePIDIndex();
-                }
-                else {
-                  // Try going backward if forward did not succeed
-                  if (tw.dp[tw.param_index].direction == DIRECTION::FORWARD) {
-                    tw.GoBackward(pid);
-                  }
-                  // In case of both failed (fwd and bwd), reset PID parameter,
-                  // decrease the update parameter dp, and switch PID parameter
-                  else {
-                    tw.ResetPIDParameter(pid);
-                    tw.ChangePIDIndex();
-                  }
-                }
-              }
-
-              if (tw.dp[tw.param_index].direction == DIRECTION::FORWARD) {
-                // Log info
-                if (tw.param_index == 0) {
-                  tw.PrintIterationState(pid);
-                }
-                tw.UpdatePIDParameter(pid);
-              }
-
-              // Reset distance, current run error
-              tw.dist_count = 0;
-              tw.error = 0;
-              tw.avg_error = 0;
-
-              // Reset the simulator
-              reset_simulator(ws);
-            }
-          }
-
-          run_car(tw, pid, cte, ws);
-        }
-      } else {
-        // Manual driving
-        std::string msg = "42[\"manual\",{}]";
-        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-      }
+// Set the handlers of the hub of w
+void serve(worker &w, server &s) {
+  uWS::Hub &h = w.h;
+
+  h.onMessage([&w, &s](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+    uint64_t received = Metrics::Now();
+    uint64_t t = received;
+    Session &session = *static_cast<Session*>(ws.getData());
+    session.log.source = session.id;
+#ifdef COUNT_ALLOCATIONS
+    size_t allocations = AllocationCount();
+    uint64_t frames = session.frames;
+#endif
+
+    // Parsing, Twiddle and steering (see pid_test)
+    message_replies replies = session.OnMessage(data, length, received, t, s.options.coalesce);
+    if (replies.reset) {
+      // Reset the simulator
+      reset_simulator(ws);
+    }
+    if (replies.manual) {
+      ws.send(MANUAL_MESSAGE, sizeof(MANUAL_MESSAGE) - 1, uWS::OpCode::TEXT);
+    }
+    if (replies.queue) {
+      w.pending.push_back(std::make_pair(&session, ws));
+    }
+    if (replies.steer) {
+      send_steer(session, ws, received, t);
     }
+
+#ifdef COUNT_ALLOCATIONS
+    // Steady-state frames (no episode end) must not touch the heap
+    const Twiddle &tw = session.tw;
+    if (session.frames != frames && !replies.reset && (!tw.is_used || tw.dist_count != 0) &&
+        AllocationCount() != allocations) {
+      std::cerr << "Heap allocations in telemetry frame: " << AllocationCount() - allocations << std::endl;
+    }
+#endif
   });
 
-  // We don't need this since we're not using HTTP but if it's removed the program
-  // doesn't compile :-(
-  h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
-    const std::string s = "<h1>Hello world!</h1>";
+  // Serve the latency histograms on /metrics (Prometheus text format), and
+  // the gains on /gains (/gains?Kp=0.2&Kd=3&min=-0.8&max=0.8 to change them)
+  h.onHttpRequest([&s](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
+    const std::string page = "<h1>Hello world!</h1>";
     if (req.getUrl().valueLength == 1)
     {
-      res->end(s.data(), s.length());
+      res->end(page.data(), page.length());
+    }
+    else if (req.getUrl().toString() == "/metrics")
+    {
+      // Histograms of all threads (readable from any thread)
+      std::vector<const Metrics*> metrics;
+      for (const std::unique_ptr<worker> &other : s.workers) {
+        metrics.push_back(&other->metrics);
+      }
+      std::ostringstream out;
+      Metrics::Write(out, metrics);
+      const std::string text = out.str();
+      res->end(text.data(), text.length());
+    }
+    else if (req.getUrl().toString().compare(0, 6, "/gains") == 0)
+    {
+      std::string url = req.getUrl().toString();
+      size_t query = url.find('?');
+      const char *locked = s.tuning ? "gains are tuned by twiddle" :
+                           s.options.gain_schedule.Enabled() ? "gains are scheduled by speed" : nullptr;
+      std::string text = handle_gains(*s.gains, locked,
+                                      query == std::string::npos ? "" : url.substr(query + 1));
+      res->end(text.data(), text.length());
     }
     else
     {
@@ -189,26 +245,110 @@ int main(int argc, char *argv[])
     }
   });
 
-  h.onConnection([&h, &tw](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
-    if (tw.it == 0) {
-      std::cout << "Connected!!!\n" << std::endl;
+  h.onConnection([&w, &s](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+    Session *session = open_session(w, s);
+    if (session == nullptr) {
+      ws.close();
+      return;
+    }
+    ws.setData(session);
+    if (session->tw.it == 0) {
+      std::cout << "Connected!!! (session " << session->id << ")\n" << std::endl;
     }
   });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+  h.onDisconnection([&w, &s](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+    Session *session = static_cast<Session*>(ws.getData());
     ws.close();
-    std::cout << "Disconnected" << std::endl;
+    if (session != nullptr) {
+      // No reply to a closed connection
+      for (size_t i = 0; i < w.pending.size(); i++) {
+        if (w.pending[i].first == session) {
+          w.pending.erase(w.pending.begin() + i);
+          break;
+        }
+      }
+      std::cout << "Disconnected (session " << session->id << ", " << session->frames << " frames)" << std::endl;
+      ws.setData(nullptr);
+      close_session(w, s, session->id);
+    }
   });
+}
 
-  int port = 4567;
-  if (h.listen(port))
-  {
-    std::cout << "Listening to port " << port << std::endl;
+int main(int argc, char *argv[])
+{
+  server s;
+
+  // [max_dist] [Kp] [Ki] [Kd] [--tune Kp,Ki,Kd] [--threads N] [--coalesce] [--checkpoint file] [--resume file] [--trace file]
+  // [--farm] [--port P] [--ports N] [--schedule file] [--breakpoint k]
+  // max_dist: -1 (default) to not use Twiddle
+  Options &options = s.options;
+  if (!ParseOptions(argc, argv, options)) {
+    return -1;
   }
-  else
-  {
-    std::cerr << "Failed to listen to port" << std::endl;
+
+  // One hub (event loop) per thread, all accepting on the same port
+  int nb_workers = options.threads > 1 ? options.threads : 1;
+  for (int i = 0; i < nb_workers; i++) {
+    s.workers.emplace_back(new worker());
+  }
+
+  // Check the resume file now rather than when the simulator connects. With
+  // --farm, this session holds the optimization all simulators run for
+  Logger *tuner_log = &s.workers[0]->log;
+  if (options.farm) {
+    s.farm_log.reset(new Logger(std::cout));
+    tuner_log = s.farm_log.get();
+  }
+  s.tuner.reset(new Session(*tuner_log, s.workers[0]->metrics, options));
+  Session &initial = *s.tuner;
+  if (!options.resume.empty() && !LoadCheckpoint(options.resume, initial.tw, initial.pid, initial.schedule_file, initial.breakpoint)) {
     return -1;
   }
-  h.run();
+  s.tuning = initial.tw.is_used;
+  if (options.farm && s.tuning) {
+    s.farm.reset(new Coordinator(initial.tw, *tuner_log));
+    initial.CheckpointInBackground();
+    s.farm->on_end_run = [&initial]() {
+      initial.Checkpoint();
+    };
+    s.farm->on_done = [&initial]() {
+      initial.SaveSchedule();
+    };
+  }
+
+  // Gains can be changed while driving (/gains), but not while Twiddle tunes them
+  s.gains.reset(new GainStore(GetGains(initial.pid)));
+
+  for (const std::unique_ptr<worker> &w : s.workers) {
+    serve(*w, s);
+    if (options.coalesce) {
+      w->pending.reserve(64);
+      uv_check_init(w->h.getLoop(), &w->check);
+      w->check.data = w.get();
+      uv_check_start(&w->check, reply_pending);
+    }
+    // The kernel spreads the connections over the threads (SO_REUSEPORT)
+    for (int port = options.port; port < options.port + options.ports; port++) {
+      if (!w->h.listen(port, nullptr, nb_workers > 1 ? uS::ListenOptions::REUSE_PORT : 0))
+      {
+        std::cerr << "Failed to listen to port " << port << std::endl;
+        return -1;
+      }
+    }
+  }
+  std::cout << "Listening to port " << options.port;
+  if (options.ports > 1) {
+    std::cout << "-" << options.port + options.ports - 1;
+  }
+  std::cout << " (" << nb_workers << " threads" << (s.farm ? ", farm" : "") << ")" << std::endl;
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < nb_workers; i++) {
+    threads.emplace_back([&s, i]() { s.workers[i]->h.run(); });
+  }
+  s.workers[0]->h.run();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
 }
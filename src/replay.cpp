@@ -0,0 +1,187 @@
+#include <uWS/uWS.h>
+#include <uv.h>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "Codec.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+// Replay a recorded trace to pid2, standing in for the simulator, and measure
+// the round trip time of every steer reply.
+struct replay_state {
+  const TraceReader *trace;
+
+  ///* pacing: 1 for real time, N for N times faster, 0 as fast as possible
+  double speed;
+
+  ///* next frame to send, and steer replies received
+  size_t next;
+  size_t replies;
+
+  ///* send time of the frames waiting for a reply, in order
+  std::deque<uint64_t> in_flight;
+
+  ///* round trip times (ns)
+  std::vector<uint64_t> rtt;
+
+  uint64_t start;
+  uint64_t end;
+  uWS::WebSocket<uWS::CLIENT> ws;
+  bool connected;
+  uv_timer_t timer;
+  Message msg;
+};
+
+void send_frame(replay_state &state) {
+  const trace_record &record = (*state.trace)[state.next++];
+  Telemetry telemetry;
+  telemetry.cte = record.cte;
+  telemetry.speed = record.speed;
+  telemetry.steering_angle = record.steering_angle;
+  EncodeTelemetry(telemetry, record.throttle, state.msg);
+
+  state.in_flight.push_back(Metrics::Now());
+  state.ws.send(state.msg.data, state.msg.length, uWS::OpCode::TEXT);
+}
+
+// Paced replay: send every frame that is due
+void on_timer(uv_timer_t *timer) {
+  replay_state &state = *static_cast<replay_state *>(timer->data);
+  const trace_record *records = state.trace->begin();
+  const double elapsed = (Metrics::Now() - state.start) * state.speed;
+  while (state.next < state.trace->Size() &&
+         records[state.next].timestamp - records[0].timestamp <= elapsed) {
+    send_frame(state);
+  }
+}
+
+void report(const replay_state &state) {
+  std::vector<uint64_t> rtt = state.rtt;
+  std::sort(rtt.begin(), rtt.end());
+  const double seconds = (state.end - state.start) * 1e-9;
+
+  std::cout << "Frames: " << state.next << " sent, " << state.replies << " replies in "
+            << seconds << "s (" << state.replies / seconds << " frames/s)" << std::endl;
+  if (rtt.empty()) {
+    return;
+  }
+  const double quantiles[] = { 0.5, 0.99, 0.999 };
+  const char *names[] = { "p50", "p99", "p999" };
+  std::cout << "Round trip (us):";
+  for (int i = 0; i < 3; i++) {
+    size_t k = std::min(rtt.size() - 1, static_cast<size_t>(quantiles[i] * rtt.size()));
+    std::cout << " " << names[i] << " " << rtt[k] * 1e-3;
+  }
+  std::cout << " max " << rtt.back() * 1e-3 << std::endl;
+}
+
+void finish(replay_state &state) {
+  state.end = Metrics::Now();
+  report(state);
+  if (state.speed > 0) {
+    uv_timer_stop(&state.timer);
+    uv_close(reinterpret_cast<uv_handle_t *>(&state.timer), nullptr);
+  }
+  if (state.connected) {
+    state.connected = false;
+    state.ws.close();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  // pid_replay trace [--speed N] [--host 127.0.0.1] [--port 4567]
+  if (argc < 2) {
+    std::cerr << "Usage: pid_replay trace [--speed N] [--host address] [--port port]" << std::endl;
+    std::cerr << "  --speed: 1 for real time, N for N times faster, 0 (default) as fast as possible" << std::endl;
+    return -1;
+  }
+  std::string host = "127.0.0.1";
+  int port = 4567;
+  double speed = 0.0;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--speed") {
+      speed = atof(argv[i + 1]);
+    } else if (arg == "--host") {
+      host = argv[i + 1];
+    } else if (arg == "--port") {
+      port = atoi(argv[i + 1]);
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return -1;
+    }
+  }
+
+  TraceReader trace(argv[1]);
+  if (!trace.IsOpen() || trace.Size() == 0) {
+    std::cerr << "Cannot read trace " << argv[1] << std::endl;
+    return -1;
+  }
+
+  uWS::Hub h;
+
+  replay_state state;
+  state.trace = &trace;
+  state.speed = speed;
+  state.next = 0;
+  state.replies = 0;
+  state.start = 0;
+  state.end = 0;
+  state.connected = false;
+  state.rtt.reserve(trace.Size());
+
+  h.onConnection([&h, &state](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+    std::cout << "Connected, replaying " << state.trace->Size() << " frames" << std::endl;
+    state.ws = ws;
+    state.connected = true;
+    state.start = Metrics::Now();
+    if (state.speed > 0) {
+      uv_timer_init(h.getLoop(), &state.timer);
+      state.timer.data = &state;
+      uv_timer_start(&state.timer, on_timer, 0, 1);
+    } else {
+      // As fast as possible: one frame in flight at a time
+      send_frame(state);
+    }
+  });
+
+  h.onMessage([&state](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length, uWS::OpCode opCode) {
+    // Only steer replies answer a telemetry frame (not reset / manual)
+    static const char steer[] = "42[\"steer\"";
+    if (length < sizeof(steer) - 1 || memcmp(data, steer, sizeof(steer) - 1) != 0 || state.in_flight.empty()) {
+      return;
+    }
+
+    state.rtt.push_back(Metrics::Now() - state.in_flight.front());
+    state.in_flight.pop_front();
+    state.replies++;
+
+    if (state.replies == state.trace->Size()) {
+      finish(state);
+    } else if (state.speed <= 0 && state.next < state.trace->Size()) {
+      send_frame(state);
+    }
+  });
+
+  h.onDisconnection([&state](uWS::WebSocket<uWS::CLIENT> ws, int code, char *message, size_t length) {
+    if (state.connected) {
+      std::cerr << "Disconnected before the end of the trace" << std::endl;
+      state.connected = false;
+      finish(state);
+    }
+  });
+
+  h.onError([](void *user) {
+    std::cerr << "Failed to connect" << std::endl;
+    exit(-1);
+  });
+
+  h.connect("ws://" + host + ":" + std::to_string(port));
+  h.run();
+}
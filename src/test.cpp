@@ -0,0 +1,707 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <new>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "AllocCounter.h"
+#include "Codec.h"
+#include "Coordinator.h"
+#include "FixedPoint.h"
+#include "GainSchedule.h"
+#include "GainStore.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Options.h"
+#include "PID.h"
+#include "PIDBank.h"
+#include "Pruner.h"
+#include "Session.h"
+#include "Trace.h"
+#include "json.hpp"
+
+// for convenience
+using json = nlohmann::json;
+
+// Checks of the control path, run by ctest. Built with
+// the counting operator new (AllocCounter.cpp, COUNT_ALLOCATIONS).
+
+namespace {
+
+int failures = 0;
+
+void Check(bool ok, const std::string &what) {
+  if (!ok) {
+    std::cerr << "FAIL: " << what << std::endl;
+    failures++;
+  }
+}
+
+// Keeps the test allocations from being optimized away
+void *volatile sink;
+
+// Allocations made by f (only its own: the arguments of Check allocate too)
+template<typename F>
+size_t CountAllocations(F f) {
+  size_t before = AllocationCount();
+  f();
+  return AllocationCount() - before;
+}
+
+// The counter sees every form of operator new (a form it doesn't replace
+// would hide allocations)
+void TestAllocationCounter() {
+  Check(CountAllocations([]() {
+    int *p = new int(1);
+    sink = p;
+    delete p;
+  }) == 1, "operator new is counted");
+
+  Check(CountAllocations([]() {
+    int *p = new int[4];
+    sink = p;
+    delete[] p;
+  }) == 1, "operator new[] is counted");
+
+  Check(CountAllocations([]() {
+    int *p = new (std::nothrow) int(1);
+    sink = p;
+    delete p;
+  }) == 1, "nothrow operator new is counted");
+
+  Check(CountAllocations([]() {
+    int *p = new (std::nothrow) int[4];
+    sink = p;
+    delete[] p;
+  }) == 1, "nothrow operator new[] is counted");
+
+#ifdef __cpp_aligned_new
+  struct alignas(64) line { char data[64]; };
+  Check(CountAllocations([]() {
+    line *p = new line;
+    sink = p;
+    delete p;
+  }) == 1, "aligned operator new is counted");
+#endif
+}
+
+// Heap allocations of the telemetry handler (Session::OnMessage, as
+// onMessage calls it) over frames of a drive, after 100 warmup frames.
+// group > 1: coalesced, replied to (SteerPending) every group frames. store:
+// gains published every 1000 frames, nullptr if none.
+size_t HandlerAllocations(Session &session, int frames, int group, GainStore *store) {
+  const int warmup = 100;
+  size_t before = 0;
+  int unexpected = 0;
+  Message in;
+  for (int i = 0; i < warmup + frames; i++) {
+    if (i == warmup) {
+      before = AllocationCount();
+    }
+    if (store != nullptr && i % 1000 == 0) {
+      pid_gains gains = store->Load();
+      gains.Kp += 0.001;
+      store->Publish(gains);
+    }
+    Telemetry sent = { 0.5 * sin(i * 0.01), 30.0 + 8.0 * sin(i * 0.003), 0.0 };
+    EncodeTelemetry(sent, session.throttle, in);
+
+    uint64_t received = Metrics::Now();
+    uint64_t t = received;
+    message_replies replies = session.OnMessage(in.data, in.length, received, t, group > 1);
+    if (group > 1 && i % group == group - 1) {
+      session.SteerPending(t);
+    }
+    // (the first farm frame starts a candidate: reset)
+    bool replied = group > 1 ? !replies.steer && replies.queue == (i % group == 0) : replies.steer && !replies.queue;
+    if (i >= warmup && (replies.reset || replies.manual || !replied)) {
+      unexpected++;
+    }
+  }
+  size_t allocations = AllocationCount() - before;
+  Check(unexpected == 0, std::to_string(unexpected) + " steady-state frames not replied to with steering only");
+  return allocations;
+}
+
+// A steady-state telemetry frame (no Twiddle episode end) doesn't touch the
+// heap, through the whole handler: parse, Twiddle or farm step, published
+// or scheduled gains and PID update, steer encoding, console log, trace
+// record, coalescing
+void TestSteadyStateAllocations() {
+  const int frames = 20000;
+  std::ostream discard(nullptr);
+  Logger log(discard);
+  Metrics metrics;
+
+  // Tuning one breakpoint of a schedule, runs long enough to never end here
+  Options tuning;
+  tuning.max_dist = 1000000;
+  tuning.breakpoint = 1;
+  GainSchedule &schedule = tuning.gain_schedule;
+  const double speeds[] = { 10.0, 25.0, 35.0 };
+  schedule.size = 3;
+  for (int k = 0; k < schedule.size; k++) {
+    schedule.speed[k] = speeds[k];
+    schedule.Kp[k] = 0.3 - 0.05 * k;
+    schedule.Ki[k] = 0.0001;
+    schedule.Kd[k] = 3.0 - 0.5 * k;
+  }
+  schedule.Update();
+
+  const std::string path = "pid_test_trace.bin";
+  remove(path.c_str());
+  {
+    Session session(log, metrics, tuning);
+    TraceWriter trace(path);
+    Check(trace.IsOpen(), "trace file opens");
+    session.trace = &trace;
+    size_t allocations = HandlerAllocations(session, frames, 1, nullptr);
+    Check(allocations == 0, "tuning: steady-state frames allocate nothing (" + std::to_string(allocations) +
+                            " allocations in " + std::to_string(frames) + " frames)");
+  }
+  remove(path.c_str());
+
+  // Driving (console log) with gains published while running, frames
+  // coalesced by 3
+  Options driving;
+  driving.Kp = 0.2;
+  driving.Ki = 0.0001;
+  driving.Kd = 3.0;
+  {
+    Session session(log, metrics, driving);
+    GainStore store(GetGains(session.pid));
+    session.gains = &store;
+    size_t allocations = HandlerAllocations(session, frames, 3, &store);
+    Check(allocations == 0, "driving: steady-state frames allocate nothing (" + std::to_string(allocations) +
+                            " allocations in " + std::to_string(frames) + " frames)");
+  }
+
+  // Running a farm candidate
+  {
+    Session tuner(log, metrics, tuning);
+    Coordinator farm(tuner.tw, log);
+    Session session(log, metrics, tuning);
+    session.JoinFarm(&farm);
+    size_t allocations = HandlerAllocations(session, frames, 1, nullptr);
+    Check(allocations == 0, "farm: steady-state frames allocate nothing (" + std::to_string(allocations) +
+                            " allocations in " + std::to_string(frames) + " frames)");
+    session.LeaveFarm();
+  }
+}
+
+// Coalesced frames (--coalesce) still count in the integral with their own
+// cte: it follows the one of a session replying to every frame
+void TestCoalescedIntegral() {
+  std::ostream discard(nullptr);
+  Logger log(discard);
+  Metrics metrics;
+  Options options;
+  options.Kp = 0.2;
+  options.Ki = 0.001;
+  options.Kd = 3.0;
+  Session plain(log, metrics, options);
+  Session coalesced(log, metrics, options);
+
+  const int group = 3;
+  double deviation = 0.0;
+  Message in;
+  for (int i = 0; i < 3000; i++) {
+    // Integral within the limits (not clamped)
+    Telemetry sent = { 0.02 * sin(i * 0.05) + 0.01 * sin(i * 1.3), 30.0, 0.0 };
+    EncodeTelemetry(sent, plain.throttle, in);
+    uint64_t t = Metrics::Now();
+    plain.OnMessage(in.data, in.length, t, t, false);
+    coalesced.OnMessage(in.data, in.length, t, t, true);
+    if (i % group == group - 1) {
+      coalesced.SteerPending(t);
+      deviation = std::max(deviation, fabs(coalesced.pid.i_error - plain.pid.i_error));
+    }
+  }
+  Check(fabs(plain.pid.i_error) > 0.01 && deviation < 1E-12,
+        "coalesced integral is the sum of every frame's cte (deviation " + std::to_string(deviation) + ")");
+}
+
+// The steer reply the handler used to build with json
+std::string SteerJson(double steering_angle, double throttle) {
+  json msgJson;
+  msgJson["steering_angle"] = steering_angle;
+  msgJson["throttle"] = throttle;
+  return "42[\"steer\"," + msgJson.dump() + "]";
+}
+
+// EncodeSteer is byte for byte json::dump(): "%.15g", ".0" on integer-like
+// values, -0.0, null for NaN and infinity
+void TestEncodeSteer() {
+  std::vector<double> values = {
+    0.0, -0.0, 1.0, -1.0, 3.0, -42.0, 1E6, 123456789.0,
+    std::numeric_limits<double>::quiet_NaN(),
+    std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+    1E15, -1E15, 1E16, -1E16, 1E17, 123456789012345.0, 1234567890123456.0,
+    1E-5, -1E-5, 1E-4, 0.0001234, 1E-300, -1E300,
+    std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::min(),
+    std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(),
+    0.1, 0.3, 0.5, 1.0 / 3.0, 2.0 / 3.0, 0.30351, 2.66123
+  };
+
+  // Steering values as the PID outputs them, and any bit pattern
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> steer(-1.0, 1.0);
+  for (int i = 0; i < 100000; i++) {
+    values.push_back(steer(random));
+    uint64_t bits = random();
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    values.push_back(x);
+  }
+
+  int mismatches = 0;
+  Message msg;
+  for (size_t i = 0; i < values.size(); i++) {
+    // Each value as the steering angle, and as the throttle
+    const double pairs[2][2] = { { values[i], 0.3 }, { -0.25, values[i] } };
+    for (const double *pair : pairs) {
+      EncodeSteer(pair[0], pair[1], msg);
+      std::string expected = SteerJson(pair[0], pair[1]);
+      if (std::string(msg.data, msg.length) != expected && mismatches++ < 10) {
+        Check(false, "EncodeSteer(" + std::to_string(pair[0]) + ", " + std::to_string(pair[1]) + ") is " +
+                     std::string(msg.data, msg.length) + ", json::dump() gives " + expected);
+      }
+    }
+  }
+  Check(mismatches == 0, std::to_string(mismatches) + " steer replies differ from json::dump()");
+}
+
+bool SameBits(double a, double b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// PIDBank matches N PID objects bit for bit, on every backend the CPU has:
+// sizes around the vector widths, custom limits, saturation, NaN and -0.0
+void TestPIDBank() {
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const size_t sizes[] = { 1, 3, 7, 8, 9, 16, 17, 31, 100 };
+  std::mt19937_64 random(7);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  for (int b = BACKEND_SCALAR; b <= PIDBank::BestBackend(); b++) {
+    BACKEND backend = static_cast<BACKEND>(b);
+    int mismatches = 0;
+    for (size_t size : sizes) {
+      PIDBank bank(size);
+      bank.backend = backend;
+      std::vector<PID> pids(size);
+      for (size_t k = 0; k < size; k++) {
+        double Kp = 0.3 * uniform(random);
+        double Ki = 0.01 * uniform(random);
+        double Kd = 3.0 * uniform(random);
+        bank.Init(k, Kp, Ki, Kd);
+        pids[k].Init(Kp, Ki, Kd);
+        // Narrow limits on every third controller, so that both clamps act
+        if (k % 3 == 2) {
+          bank.min_output_limit[k] = pids[k].min_output_limit = -0.25;
+          bank.max_output_limit[k] = pids[k].max_output_limit = 0.125;
+        }
+      }
+
+      std::vector<double> cte(size);
+      std::vector<double> out(size);
+      for (int frame = 0; frame < 200; frame++) {
+        // Errors reset now and then: a NaN stays in the integral
+        if (frame % 50 == 0) {
+          for (size_t k = 0; k < size; k++) {
+            bank.Init(k, bank.Kp[k], bank.Ki[k], bank.Kd[k]);
+            pids[k].Init();
+          }
+        }
+        for (size_t k = 0; k < size; k++) {
+          double special[] = { -0.0, 0.0, nan, 4.0, -4.0 };
+          cte[k] = (frame + k) % 11 == 0 ? special[(frame + k) % 5] : 2.0 * uniform(random);
+        }
+        bank.UpdateError(cte.data());
+        bank.TotalError(out.data());
+        for (size_t k = 0; k < size; k++) {
+          pids[k].UpdateError(cte[k]);
+          double total = pids[k].TotalError();
+          if (!SameBits(bank.p_error[k], pids[k].p_error) || !SameBits(bank.i_error[k], pids[k].i_error) ||
+              !SameBits(bank.d_error[k], pids[k].d_error) || !SameBits(out[k], total)) {
+            mismatches++;
+          }
+        }
+      }
+    }
+    Check(mismatches == 0, std::string("PIDBank ") + PIDBank::BackendName(backend) + ": " +
+                           std::to_string(mismatches) + " updates differ from PID");
+  }
+}
+
+// PID as it was before BasicPID: the arithmetic every variant must keep
+struct BaselinePID {
+  double p_error = 0.0;
+  double i_error = 0.0;
+  double d_error = 0.0;
+  double Kp;
+  double Ki;
+  double Kd;
+  double min_output_limit = -1.0;
+  double max_output_limit = 1.0;
+
+  BaselinePID(double Kp, double Ki, double Kd) : Kp(Kp), Ki(Ki), Kd(Kd) {}
+
+  void UpdateError(double cte) {
+    d_error = cte - p_error;
+    p_error = cte;
+    i_error += cte;
+    if (i_error > max_output_limit) {
+      i_error = max_output_limit;
+    }
+    if (i_error < min_output_limit) {
+      i_error = min_output_limit;
+    }
+  }
+
+  double TotalError() {
+    double total_error = Kp*p_error + Ki*i_error + Kd*d_error;
+    if (total_error > max_output_limit) {
+      total_error = max_output_limit;
+    }
+    if (total_error < min_output_limit) {
+      total_error = min_output_limit;
+    }
+    return total_error;
+  }
+};
+
+// Gains of the constexpr variant
+struct ConstGains {
+  static constexpr double Kp = 0.30351;
+  static constexpr double Ki = 0.001;
+  static constexpr double Kd = 2.66123;
+};
+
+double ToDouble(double x) {
+  return x;
+}
+
+template<int Frac>
+double ToDouble(FixedPoint<Frac> x) {
+  return x.ToDouble();
+}
+
+// Outputs of controller over cte, the gains set by Init (T: its scalar type)
+template<typename Controller, typename T>
+std::vector<double> Outputs(Controller pid, const std::vector<double> &cte) {
+  std::vector<double> outputs;
+  for (double x : cte) {
+    pid.UpdateError(T(x));
+    outputs.push_back(ToDouble(pid.TotalError()));
+  }
+  return outputs;
+}
+
+template<int Terms, typename ClampPolicy>
+std::vector<double> Outputs(double Kp, double Ki, double Kd, const std::vector<double> &cte) {
+  BasicPID<double, Terms, ClampPolicy> pid;
+  pid.Init(Kp, Ki, Kd);
+  return Outputs<BasicPID<double, Terms, ClampPolicy>, double>(pid, cte);
+}
+
+// The BasicPID variants compute what PID (the baseline arithmetic) does:
+// without a term, PID with its gain at 0; without clamps, PID inside the
+// limits; with constexpr gains, the same gains set at run time; in float
+// and fixed point, close to it
+void TestBasicPID() {
+  // A drive that saturates the integral and the output, and a gentle one
+  std::vector<double> drive;
+  std::vector<double> gentle;
+  std::mt19937_64 random(3);
+  std::uniform_real_distribution<double> noise(-0.2, 0.2);
+  for (int i = 0; i < 2000; i++) {
+    drive.push_back(2.0 * sin(i * 0.02) + noise(random));
+    gentle.push_back(0.05 * sin(i * 0.1));
+  }
+  const double Kp = 0.30351;
+  const double Ki = 0.001;
+  const double Kd = 2.66123;
+
+  int mismatches = 0;
+  PID pid;
+  pid.Init(Kp, Ki, Kd);
+  BaselinePID baseline(Kp, Ki, Kd);
+  for (double cte : drive) {
+    pid.UpdateError(cte);
+    baseline.UpdateError(cte);
+    double total = pid.TotalError();
+    mismatches += !SameBits(pid.p_error, baseline.p_error) || !SameBits(pid.i_error, baseline.i_error) ||
+                  !SameBits(pid.d_error, baseline.d_error) || !SameBits(total, baseline.TotalError());
+  }
+  Check(mismatches == 0, "PID: " + std::to_string(mismatches) + " updates differ from the baseline arithmetic");
+
+  // The zero gain terms add +0.0 (outputs compared as values: -0.0 == 0.0)
+  Check(Outputs<PID_TERMS_PD, ClampOutput>(Kp, Ki, Kd, drive) == Outputs<PID_TERMS_PID, ClampOutput>(Kp, 0.0, Kd, drive),
+        "PD is PID with Ki = 0");
+  Check(Outputs<PID_TERMS_PI, ClampOutput>(Kp, Ki, Kd, drive) == Outputs<PID_TERMS_PID, ClampOutput>(Kp, Ki, 0.0, drive),
+        "PI is PID with Kd = 0");
+  Check(Outputs<PID_TERMS_P, ClampOutput>(Kp, Ki, Kd, drive) == Outputs<PID_TERMS_PID, ClampOutput>(Kp, 0.0, 0.0, drive),
+        "P is PID with Ki = Kd = 0");
+
+  std::vector<double> clamped = Outputs<PID_TERMS_PID, ClampOutput>(Kp, Ki, Kd, gentle);
+  bool inside = true;
+  for (double output : clamped) {
+    inside = inside && output > -1.0 && output < 1.0;
+  }
+  Check(inside, "gentle drive stays inside the limits");
+  Check(Outputs<PID_TERMS_PID, NoClamp>(Kp, Ki, Kd, gentle) == clamped, "NoClamp is ClampOutput inside the limits");
+  std::vector<double> unclamped = Outputs<PID_TERMS_PID, NoClamp>(Kp, Ki, Kd, drive);
+  Check(*std::max_element(unclamped.begin(), unclamped.end()) > 1.0, "NoClamp doesn't clamp");
+
+  BasicPID<double, PID_TERMS_PID, ClampOutput, ConstGains> constant;
+  constant.Init();
+  Check(Outputs<BasicPID<double, PID_TERMS_PID, ClampOutput, ConstGains>, double>(constant, drive) ==
+        Outputs<PID_TERMS_PID, ClampOutput>(ConstGains::Kp, ConstGains::Ki, ConstGains::Kd, drive),
+        "constexpr gains are the gains set at run time");
+
+  // Rounding only: float within 1e-5, Q15.16 within 1e-3 of PID
+  std::vector<double> reference = Outputs<PID_TERMS_PID, ClampOutput>(Kp, Ki, Kd, drive);
+  BasicPID<float> single;
+  single.Init(Kp, Ki, Kd);
+  BasicPID<FixedPoint<16> > fixed;
+  fixed.Init(FixedPoint<16>(Kp), FixedPoint<16>(Ki), FixedPoint<16>(Kd));
+  std::vector<double> single_outputs = Outputs<BasicPID<float>, float>(single, drive);
+  std::vector<double> fixed_outputs = Outputs<BasicPID<FixedPoint<16> >, FixedPoint<16> >(fixed, drive);
+  double single_error = 0.0;
+  double fixed_error = 0.0;
+  for (size_t i = 0; i < reference.size(); i++) {
+    single_error = std::max(single_error, fabs(single_outputs[i] - reference[i]));
+    fixed_error = std::max(fixed_error, fabs(fixed_outputs[i] - reference[i]));
+  }
+  Check(single_error < 1E-5, "float PID is within 1e-5 of PID (" + std::to_string(single_error) + ")");
+  Check(fixed_error < 1E-3, "fixed point PID is within 1e-3 of PID (" + std::to_string(fixed_error) + ")");
+}
+
+// Curve (see Pruner) of a run with these errors per PRUNE_INTERVAL frames
+std::vector<double> Curve(const std::vector<double> &segments) {
+  std::vector<double> curve;
+  double total = 0.0;
+  for (double segment : segments) {
+    total += segment;
+    curve.push_back(total);
+  }
+  return curve;
+}
+
+// Pruning: the normal quantile, runs that clearly lose are cut, runs that
+// could still win are not, and a pruned run always scores above the best
+void TestPruner() {
+  Pruner pruner;
+  pruner.SetConfidence(0.9);
+  Check(fabs(pruner.z - 1.2815516) < 1E-6, "z of 0.9 is 1.2816 (" + std::to_string(pruner.z) + ")");
+  pruner.SetConfidence(0.99);
+  Check(fabs(pruner.z - 2.3263479) < 1E-6, "z of 0.99 is 2.3263 (" + std::to_string(pruner.z) + ")");
+  pruner.SetConfidence(0.5);
+  Check(fabs(pruner.z) < 1E-6, "z of 0.5 is 0 (" + std::to_string(pruner.z) + ")");
+
+  // Best run: 1.0 per segment over 2000 frames, with some spread
+  const int max_dist = 2000;
+  const int segments = max_dist / PRUNE_INTERVAL;
+  std::vector<double> best_segments;
+  for (int j = 0; j < segments; j++) {
+    best_segments.push_back(1.0 + 0.1 * sin(j));
+  }
+  std::vector<double> best = Curve(best_segments);
+  pruner.SetConfidence(0.95);
+  pruner.SetBest(best, max_dist, max_dist);
+  const double best_error = best.back() / max_dist;
+
+  // Twice the best error on every segment so far
+  std::vector<double> losing = Curve({ 2.1, 1.9, 2.0 });
+  Check(pruner.Prune(losing, max_dist), "a run twice as bad is pruned");
+  Check(pruner.Projected(losing, max_dist) > best_error, "a pruned run scores above the best");
+  Check(!pruner.Prune(Curve({ 2.1, 1.9 }), max_dist), "no pruning before PRUNE_MIN_CHECKPOINTS");
+
+  // Ahead of the best run, or about even with a large spread
+  Check(!pruner.Prune(Curve({ 0.9, 0.8, 0.9, 0.7 }), max_dist), "a better run is not pruned");
+  Check(!pruner.Prune(Curve({ 1.0, 1.8, 0.3, 1.1 }), max_dist), "an uncertain run is not pruned");
+  // Same total, 3 checkpoints: the spread of the second leaves its mean
+  // too uncertain for the 17 remaining segments
+  Check(pruner.Prune(Curve({ 1.3, 1.3, 1.25 }), max_dist), "a steadily worse run is pruned");
+  Check(!pruner.Prune(Curve({ 1.7, 0.9, 1.25 }), max_dist), "a worse run with spread is not pruned");
+
+  // Short of the whole distance: nothing to compare with
+  Pruner short_best;
+  short_best.SetConfidence(0.95);
+  short_best.SetBest(best, max_dist - 1, max_dist);
+  Check(!short_best.Prune(losing, max_dist), "no pruning against a run that didn't finish");
+  Pruner disabled;
+  disabled.SetBest(best, max_dist, max_dist);
+  Check(!disabled.Prune(losing, max_dist), "no pruning at confidence 0");
+
+  // Any pruned run, at any confidence, projects above the best error
+  std::mt19937_64 random(11);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  int pruned = 0;
+  int below = 0;
+  for (int i = 0; i < 20000; i++) {
+    pruner.SetConfidence(0.5 + 0.49 * uniform(random));
+    int k = PRUNE_MIN_CHECKPOINTS + static_cast<int>(uniform(random) * (segments - PRUNE_MIN_CHECKPOINTS));
+    double level = 0.8 + 0.6 * uniform(random);
+    std::vector<double> run_segments;
+    for (int j = 0; j < k; j++) {
+      run_segments.push_back(level * (1.0 + 0.5 * (uniform(random) - 0.5)));
+    }
+    std::vector<double> curve = Curve(run_segments);
+    if (pruner.Prune(curve, max_dist)) {
+      pruned++;
+      below += !(pruner.Projected(curve, max_dist) > best_error);
+    }
+  }
+  Check(pruned > 1000, "random runs get pruned (" + std::to_string(pruned) + ")");
+  Check(below == 0, std::to_string(below) + " pruned runs project at or below the best error");
+}
+
+// Score of a fake run: quadratic bowl around good gains, shorter runs far
+// from them (as a car leaving the road)
+run_result FakeRun(const std::vector<double> &values) {
+  const double target[] = { 0.3, 0.002, 3.0 };
+  const double weight[] = { 1.0, 1000.0, 0.01 };
+  double cost = 0.01;
+  for (size_t i = 0; i < values.size(); i++) {
+    cost += weight[i] * (values[i] - target[i]) * (values[i] - target[i]);
+  }
+  run_result result = { cost, cost > 0.2 ? 60 : 100, std::vector<double>(), false };
+  return result;
+}
+
+// Parameters after a committed run, and the best error so far
+std::vector<double> Committed(const Twiddle &tw) {
+  std::vector<double> state = tw.Values();
+  state.push_back(tw.best_error);
+  return state;
+}
+
+// A farm of simulators finishing their candidates in random order, some
+// running stale ones, some disconnecting mid-run, commits the runs Twiddle
+// commits alone, in the same order
+void TestCoordinator() {
+  std::ostream discard(nullptr);
+  Logger log(discard);
+  const double cache_tolerances[] = { 0.0, 1E-3 };
+  for (double tolerance : cache_tolerances) {
+    const std::string name = tolerance > 0.0 ? "farm with cache" : "farm";
+    double Kp = 0.2;
+    double Ki = 0.0;
+    double Kd = 1.0;
+    Twiddle reference(100);
+    reference.AddParameter("Kp", &Kp, 0.1);
+    reference.AddParameter("Ki", &Ki, 0.001);
+    reference.AddParameter("Kd", &Kd, 1.0);
+    reference.cache.tolerance = tolerance;
+    std::vector<std::vector<double> > expected;
+    reference.Run([](const std::vector<double> &values, const Pruner &) { return FakeRun(values); },
+                  nullptr, log, [&expected, &reference]() { expected.push_back(Committed(reference)); });
+
+    double farm_Kp = 0.2;
+    double farm_Ki = 0.0;
+    double farm_Kd = 1.0;
+    Twiddle tw(100);
+    tw.AddParameter("Kp", &farm_Kp, 0.1);
+    tw.AddParameter("Ki", &farm_Ki, 0.001);
+    tw.AddParameter("Kd", &farm_Kd, 1.0);
+    tw.cache.tolerance = tolerance;
+    Coordinator farm(tw, log);
+    std::vector<std::vector<double> > committed;
+    int done = 0;
+    farm.on_end_run = [&committed, &tw]() { committed.push_back(Committed(tw)); };
+    farm.on_done = [&done]() { done++; };
+
+    struct simulator {
+      bool attached;
+      long ticket;
+      std::vector<double> candidate;
+    };
+    std::vector<simulator> simulators(4, simulator{ true, -1, std::vector<double>() });
+    for (size_t i = 0; i < simulators.size(); i++) {
+      farm.Attach();
+    }
+
+    std::mt19937_64 random(5);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    long out_of_order = 0;
+    long stale_dropped = 0;
+    long stale_finished = 0;
+    long released = 0;
+    long steps = 0;
+    while (!farm.IsDone() && steps++ < 10000000) {
+      simulator &sim = simulators[random() % simulators.size()];
+      double action = uniform(random);
+      if (!sim.attached) {
+        if (action < 0.5) {
+          sim.attached = true;
+          farm.Attach();
+        }
+      }
+      else if (sim.ticket < 0) {
+        Pruner pruner;
+        farm.Acquire(sim.candidate, sim.ticket, pruner);
+      }
+      else if (action < 0.02) {
+        // Disconnected mid-run
+        farm.Release(sim.ticket);
+        farm.Detach();
+        sim.attached = false;
+        sim.ticket = -1;
+        released++;
+      }
+      else if (farm.IsStale(sim.ticket)) {
+        // Dropped when noticed, or finished anyway (ignored)
+        if (action < 0.5) {
+          stale_dropped++;
+        } else {
+          farm.Finish(sim.ticket, FakeRun(sim.candidate));
+          stale_finished++;
+        }
+        sim.ticket = -1;
+      }
+      else {
+        for (const simulator &other : simulators) {
+          out_of_order += other.ticket >= 0 && other.ticket < sim.ticket && !farm.IsStale(other.ticket);
+        }
+        farm.Finish(sim.ticket, FakeRun(sim.candidate));
+        sim.ticket = -1;
+      }
+    }
+
+    Check(farm.IsDone() && done == 1, name + ": done once");
+    Check(committed.size() > 100 && committed == expected,
+          name + ": commits the " + std::to_string(expected.size()) + " runs of Twiddle alone, in order (" +
+          std::to_string(committed.size()) + " committed)");
+    Check(farm.Values() == reference.Values(), name + ": same result as Twiddle alone");
+    Check(out_of_order > 0 && stale_dropped > 0 && stale_finished > 0 && released > 0,
+          name + ": results out of order (" + std::to_string(out_of_order) + "), stale candidates dropped (" +
+          std::to_string(stale_dropped) + ") and finished (" + std::to_string(stale_finished) +
+          "), candidates released (" + std::to_string(released) + ")");
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestAllocationCounter();
+  TestSteadyStateAllocations();
+  TestCoalescedIntegral();
+  TestEncodeSteer();
+  TestPIDBank();
+  TestBasicPID();
+  TestPruner();
+  TestCoordinator();
+
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed" << std::endl;
+  return 0;
+}
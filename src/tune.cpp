@@ -0,0 +1,273 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <stdlib.h>
+#include "Checkpoint.h"
+#include "Coordinator.h"
+#include "GainSchedule.h"
+#include "GainStore.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Options.h"
+#include "Parameters.h"
+#include "PID.h"
+#include "ReplayScorer.h"
+#include "Session.h"
+#include "Track.h"
+#include "Twiddle.h"
+#include "Vehicle.h"
+
+// Drive the car until Twiddle is done, returns the number of frames
+long run_twiddle(Session &session, Vehicle &car) {
+  Twiddle &tw = session.tw;
+
+  long frames = 0;
+  while (tw.is_used) {
+    uint64_t received = Metrics::Now();
+    Telemetry telemetry = car.Read();
+
+    // Same order as the telemetry handler: twiddle step, then steering
+    if (tw.Step(telemetry.cte, telemetry.speed, session.log)) {
+      session.Checkpoint();
+      car.Reset();
+    }
+
+    session.Schedule(telemetry.speed);
+    session.pid.UpdateError(telemetry.cte);
+    double steer_value = -session.pid.TotalError();
+    car.Step(steer_value, session.throttle);
+    session.Record(received, telemetry, steer_value);
+    frames++;
+  }
+  return frames;
+}
+
+// Drive a car per simulator of the farm, one frame each per tick (the
+// simulators run in parallel), until the farm is done. Returns the ticks.
+long run_farm(Coordinator &farm, std::vector<std::unique_ptr<Session> > &sims, const Track &track) {
+  std::vector<std::unique_ptr<Vehicle> > cars;
+  for (size_t i = 0; i < sims.size(); i++) {
+    cars.emplace_back(new Vehicle(track));
+  }
+
+  long ticks = 0;
+  while (!farm.IsDone()) {
+    for (size_t i = 0; i < sims.size(); i++) {
+      Session &session = *sims[i];
+      Vehicle &car = *cars[i];
+      Telemetry telemetry = car.Read();
+
+      // Next run from a standing start, as run_episode
+      if (session.farm != nullptr && session.FarmStep(telemetry.cte, telemetry.speed)) {
+        car.Reset();
+        continue;
+      }
+
+      session.Schedule(telemetry.speed);
+      session.pid.UpdateError(telemetry.cte);
+      double steer_value = session.parked ? 0.0 : -session.pid.TotalError();
+      car.Step(steer_value, session.parked ? 0.0 : session.throttle);
+    }
+    ticks++;
+  }
+  return ticks;
+}
+
+// Score one candidate on its own car, from a standing start with a fresh
+// PID. Doesn't change tw, so it can run on several threads at once.
+run_result run_episode(const Twiddle &tw, const Options &options, const Track &track,
+                       const std::vector<double> &values, const Pruner &pruner) {
+  PID pid;
+  pid.Init(options.Kp, options.Ki, options.Kd);
+  double throttle = 0.3;
+  GainSchedule schedule = options.gain_schedule;
+  for (int i = 0; i < tw.nb_params; i++) {
+    *FindParameter(tw.names[i], pid, throttle, schedule, options.breakpoint) = values[i];
+  }
+
+  Vehicle car(track);
+  double error = 0.0;
+  int dist = 0;
+  std::vector<double> curve;
+  for (;;) {
+    Telemetry telemetry = car.Read();
+    dist += 1;
+    error += telemetry.cte*telemetry.cte;
+    bool over = tw.IsRunOver(dist, telemetry.cte, telemetry.speed);
+    if (pruner.Update(curve, dist, error, over, tw.max_dist)) {
+      run_result result = { pruner.Projected(curve, tw.max_dist), tw.max_dist, curve, true };
+      return result;
+    }
+    if (over) {
+      run_result result = { error / dist, dist, curve, false };
+      return result;
+    }
+
+    if (schedule.Enabled()) {
+      schedule.Apply(pid, telemetry.speed);
+    }
+    pid.UpdateError(telemetry.cte);
+    double steer_value = -pid.TotalError();
+    car.Step(steer_value, throttle);
+  }
+}
+
+// Candidates replayed together (Twiddle: its next ones assuming each run
+// fails; the searches: their batch)
+const int REPLAY_BATCH = 8;
+
+// Score candidates on recorded drives, through the fitted lateral model:
+// all together, as the lanes of the replay's PIDBank
+std::vector<run_result> replay_batch(const Twiddle &tw, const Options &options, const ReplayScorer &replay,
+                                     const std::vector<std::vector<double> > &candidates, ThreadPool *pool) {
+  std::vector<pid_gains> gains;
+  for (const std::vector<double> &values : candidates) {
+    PID pid;
+    pid.Init(options.Kp, options.Ki, options.Kd);
+    double throttle = 0.3;
+    // No schedule (see ParseOptions): fixed gains
+    GainSchedule schedule;
+    for (int i = 0; i < tw.nb_params; i++) {
+      *FindParameter(tw.names[i], pid, throttle, schedule, -1) = values[i];
+    }
+    gains.push_back(GetGains(pid));
+  }
+  return replay.Score(gains, pool);
+}
+
+// Offline Twiddle: tune the PID gains on the in-process vehicle model,
+// the same way pid2 does with the simulator, without any network.
+int main(int argc, char *argv[])
+{
+  // Same arguments as pid2, Twiddle is always used
+  Options options;
+  options.max_dist = 2000;
+  if (!ParseOptions(argc, argv, options)) {
+    return -1;
+  }
+  if (options.max_dist <= 0) {
+    std::cerr << "Usage: pid_tune [max_dist] [Kp] [Ki] [Kd] [--tune Kp,Ki,Kd] [--optimizer name] [--budget N]"
+              << " [--schedule file] [--breakpoint k]"
+              << " [--threads N] [--cache tolerance] [--prune confidence]"
+              << " [--replay trace[,trace...]] [--sims N]"
+              << " [--checkpoint file] [--resume file] [--trace file]" << std::endl;
+    return -1;
+  }
+
+  // --replay traces: tune on the recorded drives instead of the vehicle model
+  std::unique_ptr<ReplayScorer> replay;
+  if (!options.replay.empty()) {
+    replay.reset(new ReplayScorer(options.max_dist));
+    for (const std::string &path : options.replay) {
+      if (!replay->Load(path)) {
+        std::cerr << "Cannot read trace file " << path << std::endl;
+        return -1;
+      }
+    }
+    if (!replay->Fit()) {
+      std::cerr << "Cannot fit the lateral model on the traces" << std::endl;
+      return -1;
+    }
+    for (const std::string &name : options.tune) {
+      if (name == "throttle") {
+        std::cerr << "throttle cannot be tuned on traces" << std::endl;
+        return -1;
+      }
+    }
+    std::cout << "Lateral model on " << replay->segments.size() << " drives (" << replay->Frames()
+              << " frames): a " << replay->a << ", b " << replay->b << ", b_prev " << replay->b_prev
+              << ", disturbance bias " << replay->bias << ", rms " << replay->rms << std::endl;
+  }
+
+  std::unique_ptr<Logger> log(new Logger(std::cout));
+  Metrics metrics;
+  Session session(*log, metrics, options);
+  Twiddle &tw = session.tw;
+  if (!options.resume.empty() && !LoadCheckpoint(options.resume, tw, session.pid, session.schedule_file, session.breakpoint)) {
+    return -1;
+  }
+  std::unique_ptr<TraceWriter> trace;
+  if (!options.trace.empty()) {
+    trace.reset(new TraceWriter(options.trace));
+    if (!trace->IsOpen()) {
+      std::cerr << "Cannot open trace file " << options.trace << std::endl;
+      return -1;
+    }
+    session.trace = trace.get();
+  }
+
+  Track track;
+  long frames = 0;
+
+  // Recorded drives, on N threads with --threads N
+  if (replay) {
+    std::unique_ptr<ThreadPool> pool(options.threads > 0 ? new ThreadPool(options.threads) : nullptr);
+    const ReplayScorer &scorer = *replay;
+    ThreadPool *threads = pool.get();
+    tw.RunBatches([&tw, &options, &scorer, threads](const std::vector<std::vector<double> > &candidates) {
+      return replay_batch(tw, options, scorer, candidates, threads);
+    }, REPLAY_BATCH, session.log, [&session]() {
+      session.Checkpoint();
+    });
+  }
+  // --sims N: simulators running the candidates of one optimization
+  else if (options.sims > 0) {
+    Coordinator farm(tw, session.log);
+    session.CheckpointInBackground();
+    farm.on_end_run = [&session]() {
+      session.Checkpoint();
+    };
+    std::vector<std::unique_ptr<Session> > sims;
+    for (int i = 0; i < options.sims; i++) {
+      sims.emplace_back(new Session(*log, metrics, options));
+      sims.back()->JoinFarm(&farm);
+    }
+    frames = run_farm(farm, sims, track);
+  }
+  // --threads N: independent episodes, scored on N threads
+  else if (options.threads > 0) {
+    ThreadPool pool(options.threads);
+    tw.Run([&tw, &options, &track](const std::vector<double> &values, const Pruner &pruner) {
+      return run_episode(tw, options, track, values, pruner);
+    }, &pool, session.log, [&session]() {
+      session.Checkpoint();
+    });
+  }
+  // Default: one car driving continuously, like the simulator
+  else {
+    Vehicle car(track);
+    frames = run_twiddle(session, car);
+  }
+
+  // Tuned breakpoint written back to the schedule file
+  session.SaveSchedule();
+
+  // Write the whole log before the summary
+  uint64_t trace_dropped = trace ? trace->dropped.load() : 0;
+  trace.reset();
+  log.reset();
+
+  std::cout << "Done after ";
+  if (frames > 0) {
+    std::cout << frames << " frames, ";
+  }
+  if (options.sims > 0) {
+    std::cout << "on " << options.sims << " simulators, ";
+  }
+  std::cout << tw.it << " iterations -->";
+  for (int i = 0; i < tw.nb_params; i++) {
+    std::cout << " " << *tw.params[i] << "(" << tw.names[i] << ")";
+  }
+  if (tw.cache.Enabled()) {
+    std::cout << ", cache: " << tw.cache.hits << " hits, " << tw.cache.misses << " misses";
+  }
+  if (trace_dropped > 0) {
+    std::cout << ", " << trace_dropped << " trace records dropped";
+  }
+  if (!session.schedule_file.empty()) {
+    std::cout << ", breakpoint " << options.breakpoint << " (" << session.schedule.speed[options.breakpoint]
+              << " mph) saved to " << session.schedule_file;
+  }
+  std::cout << std::endl;
+  return 0;
+}